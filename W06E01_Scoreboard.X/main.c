@@ -12,16 +12,61 @@
  * Implemented with FreeRTOS.
  */
 
-#define F_CPU 3333333
-#define USART0_BAUD_RATE(BAUD_RATE)\
-    ((float)(F_CPU * 64 / (16 * (float)BAUD_RATE)) + 0.5)
+/*
+ * UART_BAUD           - Baud rate of the serial terminal
+ * UART_BAUD_ERROR_MAX - Largest accepted baud rate error in 0,1 % units
+ * RX_BUFFER_SIZE      - Received bytes the stream buffer holds. A whole 
+ *                       burst must fit while usart_receive is not running.
+ * RX_TRIGGER_LEVEL    - Bytes in the buffer before usart_receive wakes up
+ * RX_CHUNK_SIZE       - Bytes usart_receive takes out at once (on its stack)
+ * QUEUE_LENGTH        - Digits queued for each output task. A reply takes
+ *                       about 20-30 ms at 9600 baud while a digit arrives 
+ *                       every 1 ms, so a burst waits here and in rx_buffer.
+ *                       Together they hold a burst of about 64 characters.
+ */
+#define UART_BAUD               9600
+#define UART_BAUD_ERROR_MAX     20
+#define RX_BUFFER_SIZE          32
+#define RX_TRIGGER_LEVEL        1
+#define RX_CHUNK_SIZE           8
+#define QUEUE_LENGTH            32
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "FreeRTOS.h"
 #include "clock_config.h"
 #include "queue.h"
 #include "task.h"
+#include "stream_buffer.h"
 #include "string.h"
+#include "stdlib.h"
+
+// BAUD register value when every bit is sampled S times (16 in normal mode,
+// 8 in CLK2X mode). The register has 6 fractional bits, so it is 
+// 64 * f / (S * baud), rounded to nearest.
+#define UART_BAUD_VALUE(S) \
+    ((64 * configCPU_CLOCK_HZ / (S) + UART_BAUD / 2) / UART_BAUD)
+// Resulting baud rate error in 0,1 % units, only for #if
+#define UART_BAUD_ERROR(S) \
+    ((64000 * configCPU_CLOCK_HZ / ((S) * UART_BAUD_VALUE(S)) \
+    - 1000 * UART_BAUD) / UART_BAUD)
+#define UART_BAUD_OK(S) \
+    (UART_BAUD_VALUE(S) >= 64 && UART_BAUD_VALUE(S) <= 0xFFFF && \
+    UART_BAUD_ERROR(S) <= UART_BAUD_ERROR_MAX && \
+    UART_BAUD_ERROR(S) >= -UART_BAUD_ERROR_MAX)
+
+// Normal mode tolerates more error at the receiver, so CLK2X is only used
+// when the baud rate is too high for normal mode. With 3,33 MHz normal mode
+// reaches 208333 baud and CLK2X 416666 baud.
+#if UART_BAUD_OK(16)
+#define UART_BAUD_REG           UART_BAUD_VALUE(16)
+#define UART_RXMODE             USART_RXMODE_NORMAL_gc
+#elif UART_BAUD_OK(8)
+#define UART_BAUD_REG           UART_BAUD_VALUE(8)
+#define UART_RXMODE             USART_RXMODE_CLK2X_gc
+#else
+#error "UART_BAUD is not possible with configCPU_CLOCK_HZ within UART_BAUD_ERROR_MAX"
+#endif
 
 // Define different led configurations for displaying numbers 0-9 and letter E
 // 8 bits representing the states of 8 pins
@@ -34,58 +79,108 @@ const uint8_t led_configurations[] =
 
 QueueHandle_t queue_A; // Carries data to task usart_send
 QueueHandle_t queue_B; // Carries data to task display_score
+StreamBufferHandle_t rx_buffer; // Carries received bytes to usart_receive
+volatile uint16_t rx_overruns; // Received characters lost since reported
+
+// Puts every received character into rx_buffer
+ISR(USART0_RXC_vect)
+{
+    BaseType_t woken = pdFALSE;
+    // BUFOVF tells that the receiver lost characters before this one, it 
+    // has to be read before the data
+    uint8_t status = USART0.RXDATAH;
+    uint8_t data = USART0.RXDATAL; // Reading the data clears the flag
+    
+    if (status & USART_BUFOVF_bm)
+    {
+        rx_overruns++;
+    }
+    // The buffer is full only if a burst is longer than the buffers hold
+    if (xStreamBufferSendFromISR(rx_buffer, &data, 1, &woken) == 0)
+    {
+        rx_overruns++;
+    }
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
 
-// Task used to read incoming characters via USART RX
+// Task used to handle incoming characters via USART RX
 void usart_receive(void* parameter)
 {
+    uint8_t received[RX_CHUNK_SIZE];
+    size_t count;
     uint8_t digit;
     while (1) 
     {
-        // Wait until data is available
-        while (!(USART0.STATUS & USART_RXCIF_bm))
-        {
-            ;
-        }   
-        // Receive the next character and convert it to matching integer value 
-        // (or some other value over 9 if it was not a number)
-        digit = USART0.RXDATAL - '0';
-        // Use value 10 to represent any invalid character 
-        if (digit > 9)
+        // Sleep until at least RX_TRIGGER_LEVEL characters have arrived, 
+        // then take up to RX_CHUNK_SIZE of them
+        count = xStreamBufferReceive(rx_buffer, received, sizeof(received), 
+            portMAX_DELAY);
+        for (size_t i = 0; i < count; i++)
         {
-            digit = 10;
+            // Convert the character to matching integer value 
+            // (or some other value over 9 if it was not a number)
+            digit = received[i] - '0';
+            // Use value 10 to represent any invalid character 
+            if (digit > 9)
+            {
+                digit = 10;
+            }
+            // Finally send the digit to other tasks via queues. Wait for 
+            // room instead of dropping digits, while waiting rx_buffer fills
+            // up and only then the RXC interrupt counts lost characters.
+            xQueueSend(queue_A, (void *)&digit, portMAX_DELAY);
+            xQueueSend(queue_B, (void *)&digit, portMAX_DELAY);
         }
-        // Finally send the digit to other tasks via queues
-        xQueueSend(queue_A, (void *)&digit, 10);
-        xQueueSend(queue_B, (void *)&digit, 10);
     }
 }
 
+// Sends a string via USART TX
+static void usart_send_string(const char* msg_string)
+{
+    // Iterate through the message string and send each character 
+    // one at a time
+    for (size_t i = 0; i < strlen(msg_string); i++)
+    {
+        // Wait until data can be sent
+        while (!(USART0.STATUS & USART_DREIF_bm))
+        {
+            ;
+        }
+        USART0.TXDATAL = msg_string[i];
+    } 
+}
+
 // Task used to write back messages to user via USART TX
 void usart_send(void* parameter)
 {
     uint8_t digit;
+    uint16_t lost;
+    char count[6];
     while (1) 
     {
-        // Receive the next number from queue A if it's not empty
-        if (xQueueReceive(queue_A, (void *)&digit, 0) == pdPASS)
+        // Wait for the next number from queue A
+        if (xQueueReceive(queue_A, (void *)&digit, portMAX_DELAY) == pdPASS)
         {
             // Select which message is sent back to the user's terminal: 
             // Was the entered character valid or not?
-            char* msg_string = (digit == 10) ? 
+            usart_send_string((digit == 10) ? 
                 "Error! Not a valid digit.\r\n" : 
-                "Number received!\r\n";
-
-            // Iterate through the message string and send each character 
-            // one at a time
-            for (size_t i = 0; i < strlen(msg_string); i++)
+                "Number received!\r\n");
+            
+            // Tell the user about characters lost since the last message
+            taskENTER_CRITICAL();
+            lost = rx_overruns;
+            rx_overruns = 0;
+            taskEXIT_CRITICAL();
+            if (lost)
             {
-                // Wait until data can be sent
-                while (!(USART0.STATUS & USART_DREIF_bm))
-                {
-                    ;
-                }
-                USART0.TXDATAL = msg_string[i];
-            } 
+                usart_send_string("Input too fast! Characters lost: ");
+                usart_send_string(utoa(lost, count, 10));
+                usart_send_string("\r\n");
+            }
         }
     }
 }
@@ -101,8 +196,8 @@ void display_score(void* parameter)
     uint8_t digit;  
     while (1)
     {
-        // Receive the next number from queue B if it is not empty
-        if (xQueueReceive(queue_B, (void *)&digit, 0) == pdPASS)
+        // Wait for the next number from queue B
+        if (xQueueReceive(queue_B, (void *)&digit, portMAX_DELAY) == pdPASS)
         {
            // Display the number or E if it's value was 10 (invalid)
             PORTC.OUT = led_configurations[digit]; 
@@ -115,12 +210,14 @@ int main(void)
     /* USART initialization */
     PORTA.DIRSET = PIN0_bm; // PA0 out
     PORTA.DIRCLR = PIN1_bm; // PA1 in
-    USART0.BAUD = (uint16_t)USART0_BAUD_RATE(9600);
-    USART0.CTRLB |= USART_TXEN_bm | USART_RXEN_bm;
+    USART0.BAUD = UART_BAUD_REG;
+    USART0.CTRLB |= USART_TXEN_bm | USART_RXEN_bm | UART_RXMODE;
     
-    /* Queue creation */
-    queue_A = xQueueCreate(10, sizeof(uint8_t));
-    queue_B = xQueueCreate(10, sizeof(uint8_t));
+    /* Queue and stream buffer creation */
+    queue_A = xQueueCreate(QUEUE_LENGTH, sizeof(uint8_t));
+    queue_B = xQueueCreate(QUEUE_LENGTH, sizeof(uint8_t));
+    rx_buffer = xStreamBufferCreate(RX_BUFFER_SIZE, RX_TRIGGER_LEVEL);
+    USART0.CTRLA |= USART_RXCIE_bm; // Receive interrupt, needs rx_buffer
             
     /* Task creation */
     xTaskCreate(
@@ -1,68 +1,512 @@
 /*
  * File:   adc.c
  * Provides functions for ADC usage.
+ *
+ * ADC0 scans LDR, NTC and potentiometer in the background. The RTC periodic
+ * interrupt timer starts each scan through the event system (STARTEI), and
+ * the RESRDY interrupt steps through the inputs and publishes the results of
+ * each complete scan to a snapshot table. Tasks
+ * read the table without waiting for the ADC or for each other, and the
+ * sensor bus wakes up its subscribers after each scan.
+ *
+ * Each input has a rate divider, an input is converted only on every n:th
+ * scan. Inputs that are not due are skipped and keep their previous value.
+ * The divider adapts to the signal: while the results stay within a dead 
+ * band the divider doubles after each conversion up to its maximum, and the
+ * first result outside the band snaps it back to the minimum. Steady inputs
+ * thus cost few conversions and wake-ups, but a change is followed at the
+ * fast rate right away. The watched input (see below) never backs off, so a
+ * change is noticed within one divider of the minimum.
+ *
+ * Each input can be oversampled with the hardware accumulator. The ADC adds
+ * up 4, 16 or 64 conversions by itself, and only the sum raises RESRDY. The
+ * sum is decimated to 11, 12 or 13 bits. At CLK_ADC = 3,33 MHz / 16 a single
+ * conversion takes about 15 CLK_ADC cycles, 72 us:
+ *
+ *      resolution  samples  time      RESRDY interrupts
+ *      10 bits     1        72 us     1
+ *      11 bits     4        290 us    1
+ *      12 bits     16       1,2 ms    1
+ *      13 bits     64       4,6 ms    1
+ *
+ * Even all three inputs at 13 bits fit within one scan period.
+ *
+ * Every input has a descriptor in adc_channels with all of its ADC settings,
+ * and switching to an input writes each register once. Instead of a thrown
+ * away conversion, the ADC itself waits for the input and the reference to
+ * settle: INITDLY after switching to the internal reference, SAMPDLY and
+ * SAMPLEN for the input, so one conversion per input is enough.
+ *
+ * Each input has a filter (filter.c) applied before its results are 
+ * published, so every reader of the table gets the same smoothed values. 
+ *
+ * One input can be watched with the window comparator. The comparator is
+ * enabled only for the conversion of that input, and the WCMP interrupt
+ * notifies a task when the result leaves the window around the value that
+ * caused the previous notification.
+ *
+ * In capture mode (capture.c) the scan is paused. A timer event starts each
+ * conversion of a single input, and every result goes to the capture buffer.
  */
 
+/*
+ * Starting the scan by event keeps the first sample of every scan exactly on
+ * the RTC period, no matter what the CPU is doing. Starting it from the PIT
+ * interrupt, the sample instant moved with the interrupt latency, which 
+ * grows with critical sections, the tick interrupt and context switches.
+ * The first input of the next scan is selected and the event input enabled
+ * at the end of each scan. If no input is due in the next scan, the PIT 
+ * interrupt is enabled instead to count the scan periods.
+ */
+
+/*
+ * ADC_SCAN_PERIOD  - RTC PIT period between scans, 512 cycles of the
+ *                    32,768 kHz internal oscillator is about 15,6 ms
+ * ADC_SCAN_EVENT   - RTC PIT event of that period, DIV512 on odd channels
+ * ADC_CAPTURE_USER - Event channel of the capture timer, set up by capture.c
+ */
+#define ADC_SCAN_PERIOD         RTC_PERIOD_CYC512_gc
+#define ADC_SCAN_EVENT          EVSYS_GENERATOR_RTC_PIT0_gc
+#define ADC_CAPTURE_USER        EVSYS_CHANNEL_CHANNEL2_gc
+
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "FreeRTOS.h"
-#include "semphr.h"
+#include "task.h"
 #include "adc.h"
+#include "sensorbus.h"
+#include "capture.h"
+#include "filter.h"
+
+// ADC settings of each input, indexed by LDR, NTC, POT
+static const struct
+{
+    uint8_t muxpos;
+    uint8_t ctrlc;          // Reference and sample capacitance
+    uint8_t ctrld;          // Settle delays: INITDLY, ASDV, SAMPDLY
+    uint8_t sampctrl;       // Extra sample length in CLK_ADC cycles
+    uint8_t resolution;     // Default ADC_RES_*, sets the accumulation
+} adc_channels[ADC_CHANNELS] =
+{
+    // LDR, PE0, internal 2,5 V reference. The reference needs 16 CLK_ADC 
+    // (77 us) to start up after the potentiometer used VDD, the divider 
+    // with the LDR has a high impedance and samples longer.
+    {ADC_MUXPOS_AIN8_gc, ADC_SAMPCAP_bm | ADC_REFSEL_INTREF_gc, 
+        ADC_INITDLY_DLY16_gc | ADC_SAMPDLY0_bm, 8, ADC_RES_10BIT},
+    // NTC, PE1, internal 2,5 V reference
+    {ADC_MUXPOS_AIN9_gc, ADC_SAMPCAP_bm | ADC_REFSEL_INTREF_gc, 
+        ADC_INITDLY_DLY16_gc | ADC_SAMPDLY0_bm, 2, ADC_RES_10BIT},
+    // POT, PF4, VDD as reference. Noisy without oversampling, varying the
+    // sample delay keeps the accumulated samples from sharing the same noise.
+    {ADC_MUXPOS_AIN14_gc, ADC_SAMPCAP_bm | ADC_REFSEL_VDDREF_gc, 
+        ADC_ASDV_bm | ADC_SAMPDLY0_bm, 2, ADC_RES_12BIT},
+};
+
+// Resolution of each input, ADC_RES_*, set from adc_channels by adc_init()
+static volatile uint8_t adc_resolution[ADC_CHANNELS];
+
+// Accumulator setting of each resolution, indexed by ADC_RES_*
+static const uint8_t adc_sampnum[] =
+{
+    ADC_SAMPNUM_ACC1_gc,
+    ADC_SAMPNUM_ACC4_gc,
+    ADC_SAMPNUM_ACC16_gc,
+    ADC_SAMPNUM_ACC64_gc,
+};
+
+// Adaptive rate of each input. Dividers are in scans, the dead band in 
+// results after filtering.
+static struct
+{
+    uint8_t min;
+    uint8_t max;
+    uint16_t deadband;
+    uint16_t reference;     // Result that started the current dead band
+} adc_adapt[ADC_CHANNELS] =
+{
+    {4, 32, 4, 0},      // LDR, 62,5 ms...500 ms
+    {16, 128, 2, 0},    // NTC, 250 ms...2 s
+    {1, 8, 12, 0},      // POT, 15,6 ms...125 ms, 15,6 ms while watched
+};
+
+// Current divider of each input, converted on every n:th scan
+static uint8_t adc_rate[ADC_CHANNELS] = {4, 16, 1};
+static uint8_t adc_rate_count[ADC_CHANNELS];
 
-SemaphoreHandle_t mutex; 
+// Filter of each input, also only touched by the RESRDY interrupt once set
+static struct filter adc_filters[ADC_CHANNELS];
+
+// Window comparator watch, ADC_CHANNELS = no input watched
+static volatile uint8_t adc_watch_input = ADC_CHANNELS;
+static volatile uint16_t adc_watch_window;
+static TaskHandle_t adc_watch_task;
+static uint16_t adc_watch_center;
+
+// Scan state, only touched by the interrupts
+static uint8_t adc_scan_channel;
+static uint8_t adc_scan_shift;
+static uint8_t adc_scan_due;    // Inputs converted in this scan, bit mask
+static volatile uint8_t adc_capturing;
+static uint16_t adc_scan_results[ADC_CHANNELS];
+
+// Results of the latest complete scan. seq changes whenever the values do.
+static volatile struct adc_snapshot adc_table;
+
+
+// Returns the first input due in this scan starting from input, or 
+// ADC_CHANNELS if there are no more
+static uint8_t adc_scan_next(uint8_t input)
+{
+    while ((input < ADC_CHANNELS) && !(adc_scan_due & (1 << input)))
+    {
+        input++;
+    }
+    return input;
+}
+
+static void adc_window_set(void)
+{
+    // Window around the center, clamped to the result range. The comparator
+    // sees the accumulated sum, so scale it like the sum.
+    uint16_t max = (1 << (10 + adc_scan_shift)) - 1;
+    uint16_t low = (adc_watch_center > adc_watch_window) ? 
+        adc_watch_center - adc_watch_window : 0;
+    uint16_t high = (adc_watch_center < max - adc_watch_window) ? 
+        adc_watch_center + adc_watch_window : max;
+    
+    ADC0.WINLT = low << adc_scan_shift;
+    ADC0.WINHT = high << adc_scan_shift;
+    ADC0.CTRLE = ADC_WINCM_OUTSIDE_gc;
+}
+
+static void adc_channel_select(uint8_t input)
+{
+    // Whole registers are written, so nothing of the previous input sticks
+    ADC0.MUXPOS = adc_channels[input].muxpos;
+    ADC0.CTRLC = ADC_PRESC_DIV16_gc | adc_channels[input].ctrlc;
+    ADC0.CTRLD = adc_channels[input].ctrld;
+    ADC0.SAMPCTRL = adc_channels[input].sampctrl;
+    adc_scan_shift = adc_resolution[input];
+    ADC0.CTRLB = adc_sampnum[adc_scan_shift];
+    if (input == adc_watch_input)
+    {
+        adc_window_set();
+    }
+    else
+    {
+        ADC0.CTRLE = ADC_WINCM_NONE_gc;
+    }
+}
+
+// Counts one scan period and arms the next scan with the inputs due in it.
+// Called at the end of each scan, or from the PIT interrupt while nothing
+// is armed.
+static void adc_scan_prepare(void)
+{
+    uint8_t input;
+    
+    adc_scan_due = 0;
+    for (input = 0; input < ADC_CHANNELS; input++)
+    {
+        if (++adc_rate_count[input] >= adc_rate[input])
+        {
+            adc_rate_count[input] = 0;
+            adc_scan_due |= (1 << input);
+        }
+    }
+    
+    adc_scan_channel = adc_scan_next(0);
+    if (adc_scan_channel < ADC_CHANNELS)
+    {
+        // Next PIT event starts the first input
+        adc_channel_select(adc_scan_channel);
+        ADC0.EVCTRL = ADC_STARTEI_bm;
+        RTC.PITINTCTRL = 0;
+    }
+    else
+    {
+        // Nothing due, only count the next period. The flag is set on every
+        // period even while the interrupt is disabled, clear the one of the
+        // period that started this scan or it would count twice.
+        ADC0.EVCTRL = 0;
+        RTC.PITINTFLAGS = RTC_PI_bm;
+        RTC.PITINTCTRL = RTC_PI_bm;
+    }
+}
 
 void adc_init(void)
 {
-    mutex = xSemaphoreCreateMutex(); // Create mutex
+    uint8_t input;
     
-    PORTE.DIRCLR = PIN0_bm; // Set PE0 (LDR) as in 
-    PORTE.DIRCLR = PIN1_bm; // Set PE0 (NTC-Thermistor) as in 
+    for (input = 0; input < ADC_CHANNELS; input++)
+    {
+        adc_resolution[input] = adc_channels[input].resolution;
+    }
+    
+    PORTE.DIRCLR = PIN0_bm; // Set PE0 (LDR) as in
+    PORTE.DIRCLR = PIN1_bm; // Set PE0 (NTC-Thermistor) as in
     PORTF.DIRCLR = PIN4_bm; // Set PF4 (Potentiometer) as in
     PORTE.PIN0CTRL |= PORT_ISC_INPUT_DISABLE_gc; // Disable PE0 input buffer
     PORTE.PIN1CTRL |= PORT_ISC_INPUT_DISABLE_gc; // Disable PE1 input buffer
     PORTF.PIN4CTRL |= PORT_ISC_INPUT_DISABLE_gc; // Disable PF4 input buffer
     VREF.CTRLA |= VREF_ADC0REFSEL_2V5_gc; // Use 2,5V internal reference
-    ADC0.CTRLC |= ADC_PRESC_DIV16_gc; // Set ADC0 prescaler to 16
+    // Median removes LDR spikes that would flicker the backlight, the NTC
+    // changes slowly so a low-pass is enough
+    filter_init(&adc_filters[LDR], FILTER_MEDIAN5, 0);
+    filter_init(&adc_filters[NTC], FILTER_IIR, 2);
+    filter_init(&adc_filters[POT], FILTER_NONE, 0);
+    
+    // Interrupt when a result is ready or outside the comparator window
+    ADC0.INTCTRL = ADC_RESRDY_bm | ADC_WCMP_bm;
     ADC0.CTRLA |= ADC_ENABLE_bm; // Enable ADC using default 10-bit resolution
+
+    /* RTC periodic interrupt timer event starts the scans */
+    RTC.CLKSEL = RTC_CLKSEL_INT32K_gc; // 32,768 kHz internal oscillator
+    while (RTC.PITSTATUS & RTC_CTRLBUSY_bm)
+    {
+        ; // Wait for the PIT to synchronize
+    }
+    RTC.PITCTRLA = ADC_SCAN_PERIOD | RTC_PITEN_bm;
+    EVSYS.CHANNEL1 = ADC_SCAN_EVENT;
+    EVSYS.USERADC0 = EVSYS_CHANNEL_CHANNEL1_gc;
+    adc_scan_prepare(); // Arm the first scan
+}
+
+void adc_snapshot_get(struct adc_snapshot *snapshot)
+{
+    uint8_t input;
+
+    // A scan finishing in the middle of the copy changes seq, then copy again
+    do
+    {
+        snapshot->seq = adc_table.seq;
+        for (input = 0; input < ADC_CHANNELS; input++)
+        {
+            snapshot->value[input] = adc_table.value[input];
+        }
+    } while (snapshot->seq != adc_table.seq);
+}
+
+void adc_resolution_set(uint8_t input, uint8_t resolution)
+{
+    struct filter *f = &adc_filters[input];
+    
+    // Takes effect from the next scan on. The filter history has the old 
+    // scale, so start the filter over.
+    taskENTER_CRITICAL();
+    adc_resolution[input] = resolution;
+    filter_init(f, f->type, f->param);
+    taskEXIT_CRITICAL();
 }
 
-uint16_t adc_converse(void)
+void adc_filter_set(uint8_t input, uint8_t type, uint8_t param)
 {
-    ADC0.COMMAND = ADC_STCONV_bm; // Start ADC conversion
-    while(!(ADC0.INTFLAGS & ADC_RESRDY_bm))
+    taskENTER_CRITICAL();
+    filter_init(&adc_filters[input], type, param);
+    taskEXIT_CRITICAL();
+}
+
+void adc_rate_set(uint8_t input, uint8_t min_divider, uint8_t max_divider, 
+    uint16_t deadband)
+{
+    taskENTER_CRITICAL();
+    adc_adapt[input].min = min_divider;
+    adc_adapt[input].max = max_divider;
+    adc_adapt[input].deadband = deadband;
+    adc_rate[input] = min_divider;
+    taskEXIT_CRITICAL();
+}
+
+// Adapts the rate of the input to its new result
+static void adc_rate_adapt(uint8_t input, uint16_t value)
+{
+    uint16_t reference = adc_adapt[input].reference;
+    uint16_t difference = (value > reference) ? 
+        value - reference : reference - value;
+    
+    if (difference > adc_adapt[input].deadband)
+    {
+        // Changed, back to the fast rate and a new dead band
+        adc_adapt[input].reference = value;
+        adc_rate[input] = adc_adapt[input].min;
+    }
+    else if ((input != adc_watch_input) && 
+        (adc_rate[input] < adc_adapt[input].max))
+    {
+        // Steady, back off
+        adc_rate[input] = (adc_rate[input] > adc_adapt[input].max / 2) ? 
+            adc_adapt[input].max : adc_rate[input] * 2;
+    }
+}
+
+void adc_watch(uint8_t input, uint16_t window, TaskHandle_t task)
+{
+    // A WCMP flag left from the old settings would notify the new task
+    taskENTER_CRITICAL();
+    adc_watch_window = window;
+    adc_watch_task = task;
+    adc_watch_input = input;
+    if (input < ADC_CHANNELS)
     {
-        ; // Wait for conversion to finish
+        // Fixed at the fastest rate, a backed off input would notice the
+        // first change only after its longest divider
+        adc_rate[input] = adc_adapt[input].min;
     }
-    return ADC0.RES;
+    ADC0.INTFLAGS = ADC_WCMP_bm;
+    taskEXIT_CRITICAL();
 }
 
-uint16_t adc_read(uint8_t input)
-{   
-    // Wait until mutex is available and take it
-    xSemaphoreTake(mutex, portMAX_DELAY);
+void adc_capture_set(uint8_t input)
+{
+    taskENTER_CRITICAL();
+    // Disabling the ADC aborts a conversion in progress
+    ADC0.CTRLA &= ~ADC_ENABLE_bm;
+    ADC0.INTFLAGS = ADC_RESRDY_bm | ADC_WCMP_bm;
     
-    // Select correct ADC input and reference voltage
-    switch (input)
-    {
-        case LDR:
-            ADC0.MUXPOS = ADC_MUXPOS_AIN8_gc; // Set AIN8 (PE0) as ADC input
-            ADC0.CTRLC |= ADC_REFSEL_INTREF_gc; // Internal reference voltage
-            break;  
-            
-        case NTC:       
-            ADC0.MUXPOS = ADC_MUXPOS_AIN9_gc; // Set AIN14 (PE1) as ADC input
-            ADC0.CTRLC |= ADC_REFSEL_INTREF_gc; // VDD as reference voltage
-            break;     
-            
-        case POT:
-            ADC0.MUXPOS = ADC_MUXPOS_AIN14_gc; // Set AIN14 (PF4) as ADC input
-            ADC0.CTRLC |= ADC_REFSEL_VDDREF_gc; // VDD as reference voltage      
-    }   
+    if (input < ADC_CHANNELS)
+    {
+        // Conversions started by the capture timer only, single 10-bit 
+        // samples without the comparator. The event is switched while the
+        // ADC is off, so a PIT event can not slip a sample in between.
+        EVSYS.USERADC0 = ADC_CAPTURE_USER;
+        adc_channel_select(input);
+        ADC0.CTRLB = ADC_SAMPNUM_ACC1_gc;
+        ADC0.CTRLE = ADC_WINCM_NONE_gc;
+        ADC0.EVCTRL = ADC_STARTEI_bm;
+        RTC.PITINTCTRL = 0;
+        adc_capturing = 1;
+    }
+    else
+    {
+        // Back to the scan, started again by the RTC event
+        EVSYS.USERADC0 = EVSYS_CHANNEL_CHANNEL1_gc;
+        adc_capturing = 0;
+        adc_scan_prepare();
+    }
+    ADC0.CTRLA |= ADC_ENABLE_bm;
+    taskEXIT_CRITICAL();
+}
+
+uint16_t adc_capture_rate_max(uint8_t input)
+{
+    // Single conversions at CLK_ADC = CLK_PER / 16 (adc_channel_select()):
+    // sample delay, 2 + SAMPLEN sample cycles, 13 conversion cycles and one
+    // to synchronize the start. ASDV adds up to 15 cycles of delay.
+    uint8_t cycles = 2 + adc_channels[input].sampctrl + 13 + 1 + 
+        ((adc_channels[input].ctrld & ADC_SAMPDLY_gm) >> ADC_SAMPDLY_gp);
     
-    // Do ADC conversion two times and save the latter result
-    adc_converse();
-    uint16_t final_result = adc_converse();
+    if (adc_channels[input].ctrld & ADC_ASDV_bm)
+    {
+        cycles += 15;
+    }
+    return configCPU_CLOCK_HZ / (16UL * cycles);
+}
+
+uint16_t adc_get(uint8_t input)
+{
+    struct adc_snapshot snapshot;
+
+    adc_snapshot_get(&snapshot);
+    return snapshot.value[input];
+}
+
+uint16_t adc_to_10bit(uint8_t input, uint16_t value)
+{
+    // ADC_RES_* is the number of bits above 10
+    return value >> adc_resolution[input];
+}
+
+ISR(RTC_PIT_vect)
+{
+    RTC.PITINTFLAGS = RTC_PI_bm;
+    
+    // Only enabled while no scan is armed. Count this scan period and arm 
+    // the next one if any input is due by then.
+    if (!adc_capturing)
+    {
+        adc_scan_prepare();
+    }
+}
+
+ISR(ADC0_RESRDY_vect)
+{
+    uint16_t result = ADC0.RES; // Reading the result clears the flag
+    BaseType_t woken = pdFALSE;
+    uint8_t converted;
+    uint8_t input;
+
+    if (adc_capturing)
+    {
+        capture_sample_from_isr(result, &woken);
+        if (woken)
+        {
+            portYIELD_FROM_ISR();
+        }
+        return;
+    }
+
+    // The rest of the scan is started from here, ignore further events
+    ADC0.EVCTRL = 0;
     
-    // Make mutex available again before returning
-    xSemaphoreGive(mutex); 
-    return final_result; 
+    // 4^n samples add 2n bits, keeping n of them gives 10 + n bits
+    adc_scan_results[adc_scan_channel] = result >> adc_scan_shift;
+    adc_scan_channel = adc_scan_next(adc_scan_channel + 1);
+    if (adc_scan_channel < ADC_CHANNELS)
+    {
+        // Continue with the next input
+        adc_channel_select(adc_scan_channel);
+        ADC0.COMMAND = ADC_STCONV_bm;
+        return;
+    }
+
+    // Scan complete. Tasks can not run in the middle of this, so all of
+    // them see either the old or the new set of values.
+    converted = adc_scan_due;
+    for (input = 0; input < ADC_CHANNELS; input++)
+    {
+        if (converted & (1 << input))
+        {
+            adc_table.value[input] = filter_apply(&adc_filters[input], 
+                adc_scan_results[input]);
+            adc_rate_adapt(input, adc_table.value[input]);
+        }
+    }
+    adc_table.seq++;
+    // Replaces adc_scan_due with the inputs of the next scan
+    adc_scan_prepare();
+    
+    // Wake up the subscribers of the inputs converted in this scan
+    sensorbus_publish_from_isr(converted, &woken);
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+ISR(ADC0_WCOMP_vect)
+{
+    BaseType_t woken = pdFALSE;
+    
+    ADC0.INTFLAGS = ADC_WCMP_bm;
+    if (adc_watch_input >= ADC_CHANNELS)
+    {
+        // Watching was stopped after the comparison
+        return;
+    }
+    
+    // RESRDY has the higher priority, so the result of the watched input is
+    // already stored. Center the next window on it.
+    adc_watch_center = adc_scan_results[adc_watch_input];
+    // RESRDY may already have selected the watched input for the next scan
+    // with the old window. Without moving it, the next result would be 
+    // compared with the old center and notify again for the same change.
+    if (!adc_capturing && (adc_scan_channel == adc_watch_input))
+    {
+        adc_window_set();
+    }
+    vTaskNotifyGiveFromISR(adc_watch_task, &woken);
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
 }
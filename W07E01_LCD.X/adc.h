@@ -1,19 +1,77 @@
 #ifndef ADC_H
 #define ADC_H
 
-/* Makes all required inital configurations for ADC usage. */
-void adc_init(void);
- 
-/* Performs a single ADC conversion. */
-uint16_t adc_converse(void);
-
-/* Mutex-protected function, which first makes all necessary ADC configurations 
- * for the given input before calling adc_converse(). */
-uint16_t adc_read(uint8_t input);
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
 
-// Possible inputs for adc_read
+// Inputs scanned by the ADC, also indices of adc_snapshot.value
 #define LDR 0
 #define NTC 1
 #define POT 2
+#define ADC_CHANNELS 3
+
+// Resolutions for adc_resolution_set(). Results range from 0 to 2^bits - 1.
+#define ADC_RES_10BIT 0 // Single conversion
+#define ADC_RES_11BIT 1 // 4 conversions accumulated and decimated
+#define ADC_RES_12BIT 2 // 16 conversions accumulated and decimated
+#define ADC_RES_13BIT 3 // 64 conversions accumulated and decimated
+
+/* Results of one complete scan. seq changes after every scan. */
+struct adc_snapshot
+{
+    uint16_t value[ADC_CHANNELS];
+    uint8_t seq;
+};
+
+/* Makes all required inital configurations for ADC usage and starts the 
+ * background scan of all inputs. */
+void adc_init(void);
+
+/* Copies the results of the latest scan. All values come from the same scan.
+ * Never blocks. */
+void adc_snapshot_get(struct adc_snapshot *snapshot);
+
+/* Sets the resolution (ADC_RES_*) of the given input. Extra bits come from
+ * oversampling in the ADC accumulator, see adc.c for the conversion times.
+ * By default the potentiometer uses 12 bits and the others 10 bits. */
+void adc_resolution_set(uint8_t input, uint8_t resolution);
+
+/* Sets the filter (FILTER_* in filter.h) applied to the results of the given
+ * input. By default LDR has FILTER_MEDIAN5, NTC FILTER_IIR with param 2 and
+ * POT no filter. */
+void adc_filter_set(uint8_t input, uint8_t type, uint8_t param);
+
+/* Sets the rate of the given input. It is converted on every divider:th scan,
+ * where the divider doubles from min_divider up to max_divider while the 
+ * results stay within deadband, and drops back to min_divider when they do
+ * not. Equal dividers give a fixed rate. The scan period is about 15,6 ms. 
+ * The watched input (adc_watch()) stays at min_divider. */
+void adc_rate_set(uint8_t input, uint8_t min_divider, uint8_t max_divider, 
+    uint16_t deadband);
+
+/* Watches the given input with the ADC window comparator. The task gets a 
+ * notification whenever the result differs by more than window from the 
+ * result of the previous notification, so at most once per scan. The input
+ * is converted at its fastest rate (adc_rate_set()) while watched. Only one
+ * input can be watched at a time. */
+void adc_watch(uint8_t input, uint16_t window, TaskHandle_t task);
+
+/* Pauses the scan and hands the ADC to capture.c, converting only the given
+ * input whenever the capture timer event on event channel 2 triggers. 
+ * ADC_CHANNELS resumes the scan. Use capture_start() and capture_stop() 
+ * instead of calling this. */
+void adc_capture_set(uint8_t input);
+
+/* Returns the highest capture rate of the given input in Hz, limited by 
+ * the conversion time of one sample. */
+uint16_t adc_capture_rate_max(uint8_t input);
+
+/* Returns the latest result of the given input. Never blocks. */
+uint16_t adc_get(uint8_t input);
+
+/* Scales a result of the given input to 10 bits, 0 to 1023, whatever its 
+ * resolution. For showing results in the same range as before oversampling. */
+uint16_t adc_to_10bit(uint8_t input, uint16_t value);
 
-#endif /* ADC_H */
\ No newline at end of file
+#endif /* ADC_H */
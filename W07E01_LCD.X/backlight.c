@@ -4,12 +4,15 @@
  */
 
 #define TCB_CMP_INITIAL_VALUE               0x00FF // off
+#define POT_INTERACTION                     41 // 1 % of the 12-bit pot range
 
 #include <avr/io.h>
 #include "FreeRTOS.h"
 #include "task.h"
 #include "adc.h"
+#include "sensorbus.h"
 #include "main.h"
+#include "log.h"
 
 void backlight_init(void)
 {
@@ -25,28 +28,36 @@ void backlight_init(void)
 
 void backlight_auto_adjust(void* parameter)
 {        
+    struct adc_snapshot readings;
     uint8_t brightness;
     
+    // Adjust brightness after every new LDR reading (62,5 ms)
+    sensorbus_subscribe(SENSORBUS_INPUT(LDR), 1);
+    
     // 200 ms delay before entering superloop
     vTaskDelay(200 / portTICK_PERIOD_MS);
     while (1) 
     {
-        // Take LDR reading and scale down its value range from 0-1023 to 0-255
-        brightness = adc_read(LDR) / 4;
+        sensorbus_wait(&readings);
+        // Scale down LDR value range from 0-1023 to 0-255. The ADC filters
+        // out LDR spikes, so they do not show up as flicker.
+        brightness = readings.value[LDR] / 4;
         TCB3.CCMPH = brightness; // Set new brightness level    
-        // Wait 75 ms before adjusting brightness again
-        vTaskDelay(75 / portTICK_PERIOD_MS);
     }
     vTaskDelete(NULL);
 }
 
 void backlight_control(void* parameter)
 {    
+    // Potentiometer turned by at least 1 % counts as user interaction. The
+    // ADC window comparator notifies this task about it.
+    adc_watch(POT, POT_INTERACTION, bl_ctrl_handle);
+    
     // 200 ms delay before entering superloop
     vTaskDelay(200 / portTICK_PERIOD_MS);
     while (1)
     {
-        // Wait up to 10 seconds if this task gets notified from dummy task 
+        // Wait up to 10 seconds if this task gets notified by the ADC 
         // because of potentiometer interaction... 
         
         // If 10 seconds pass without interaction, suspend backlight 
@@ -55,12 +66,14 @@ void backlight_control(void* parameter)
         {
             vTaskSuspend(bl_adj_handle);
             TCB3.CCMPH = 0x00; // off
+            LOG0("backlight off after inactivity");
         }
         // Whenever interaction occurs, make backlight available again by 
         // resuming the backlight adjusting task
         else
         {
             vTaskResume(bl_adj_handle);
+            LOG1("pot moved to %u", adc_get(POT));
         }
     }
     vTaskDelete(NULL);
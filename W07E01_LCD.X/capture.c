@@ -0,0 +1,227 @@
+/*
+ * File:   capture.c
+ * High-rate capture of a single ADC input to UART.
+ *
+ * TCA0 overflows at the sample rate and starts each conversion through the
+ * event system, so the sample period does not depend on interrupt latency. 
+ * The ADC interrupt collects the results into blocks and pushes each full
+ * block into a stream buffer, which wakes up capture_send only once per 
+ * block. capture_send packs the block as differences (see capture.h) and 
+ * writes it to UART in a frame, so that it cannot be mixed up with the 
+ * reports and log records on the same UART. If the stream buffer has no 
+ * room for a block, its samples are dropped and counted as overruns.
+ *
+ * TCA0 runs from CLK_PER through the smallest prescaler that fits the 
+ * sample period into 16 bits, so any rate from 1 Hz up works. The rate is
+ * limited by the conversion time of the input, adc_capture_rate_max(), 
+ * about 8,3 kHz for the LDR. Higher rates are rejected. The sustained rate 
+ * is also limited by UART. A block of slowly changing samples packs into
+ * about 20 bytes, plus 6 bytes of framing, so UART_BAUD of 115200 carries
+ * about 7000 samples per second, and anything above that shows up as 
+ * overruns.
+ */
+
+/*
+ * CAPTURE_INPUT          - Input captured when SW0 is pressed
+ * CAPTURE_RATE_HZ        - Its sample rate
+ * CAPTURE_BUFFER_BLOCKS  - Stream buffer size in blocks
+ * CAPTURE_DEBOUNCE_MS    - SW0 presses closer than this are bounces
+ */
+#define CAPTURE_INPUT           LDR
+#define CAPTURE_RATE_HZ         2000
+#define CAPTURE_BUFFER_BLOCKS   8
+#define CAPTURE_DEBOUNCE_MS     200
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stream_buffer.h"
+#include "adc.h"
+#include "capture.h"
+#include "uart.h"
+#include "log.h"
+#include "telemetry.h"
+
+#define CAPTURE_BLOCK_BYTES     (CAPTURE_BLOCK_SAMPLES * sizeof(uint16_t))
+
+// TCA0 prescalers, indexed by the CLKSEL field value
+static const uint16_t capture_prescalers[] = {1, 2, 4, 8, 16, 64, 256, 1024};
+
+static StreamBufferHandle_t capture_buffer;
+static volatile uint8_t capture_on;
+static volatile uint16_t capture_overrun_count;
+
+// Block being filled by the ADC interrupt
+static uint16_t capture_block[CAPTURE_BLOCK_SAMPLES];
+static uint8_t capture_block_count;
+
+void capture_init(void)
+{
+    capture_buffer = xStreamBufferCreate(
+        CAPTURE_BUFFER_BLOCKS * CAPTURE_BLOCK_BYTES, CAPTURE_BLOCK_BYTES);
+    
+    // TCA0 overflow event starts ADC0 conversions. Event channel 1 is taken
+    // by the ADC scan, use channel 2 (ADC_CAPTURE_USER in adc.c).
+    EVSYS.CHANNEL2 = EVSYS_GENERATOR_TCA0_OVF_LUNF_gc;
+    
+    // SW0 (PF6) toggles capture, pull-up on, interrupt on press
+    PORTF.DIRCLR = PIN6_bm;
+    PORTF.PIN6CTRL = PORT_PULLUPEN_bm | PORT_ISC_FALLING_gc;
+}
+
+uint8_t capture_start(uint8_t input, uint16_t rate_hz)
+{
+    uint8_t clksel;
+    uint32_t period;
+    
+    if ((rate_hz == 0) || (rate_hz > adc_capture_rate_max(input)))
+    {
+        return 0;
+    }
+    
+    // Smallest prescaler that fits the period into 16 bits. Even 1 Hz fits
+    // with DIV64, so the loop ends within the table.
+    for (clksel = 0; ; clksel++)
+    {
+        period = (configCPU_CLOCK_HZ / capture_prescalers[clksel] + 
+            rate_hz / 2) / rate_hz;
+        if (period <= 0x10000)
+        {
+            break;
+        }
+    }
+    
+    capture_stop();
+    capture_block_count = 0;
+    capture_overrun_count = 0;
+    capture_on = 1;
+    adc_capture_set(input);
+    
+    // Overflow at the sample rate, the counter counts PER + 1 cycles
+    TCA0.SINGLE.CNT = 0;
+    TCA0.SINGLE.PER = (uint16_t)(period - 1);
+    TCA0.SINGLE.CTRLA = (clksel << TCA_SINGLE_CLKSEL_gp) | 
+        TCA_SINGLE_ENABLE_bm;
+    return 1;
+}
+
+void capture_stop(void)
+{
+    TCA0.SINGLE.CTRLA = 0;
+    if (capture_on)
+    {
+        capture_on = 0;
+        adc_capture_set(ADC_CHANNELS);
+    }
+}
+
+uint8_t capture_active(void)
+{
+    return capture_on;
+}
+
+uint16_t capture_overruns(void)
+{
+    uint16_t count;
+    
+    taskENTER_CRITICAL();
+    count = capture_overrun_count;
+    taskEXIT_CRITICAL();
+    return count;
+}
+
+void capture_sample_from_isr(uint16_t sample, BaseType_t *woken)
+{
+    capture_block[capture_block_count++] = sample;
+    if (capture_block_count < CAPTURE_BLOCK_SAMPLES)
+    {
+        return;
+    }
+    capture_block_count = 0;
+    
+    // Only whole blocks go into the buffer, otherwise the stream would lose
+    // its block boundaries
+    if (xStreamBufferSpacesAvailable(capture_buffer) >= CAPTURE_BLOCK_BYTES)
+    {
+        xStreamBufferSendFromISR(capture_buffer, capture_block, 
+            CAPTURE_BLOCK_BYTES, woken);
+    }
+    else
+    {
+        capture_overrun_count += CAPTURE_BLOCK_SAMPLES;
+    }
+}
+
+// Writes value as a varint, returns a pointer past the last byte
+static uint8_t *capture_varint(uint8_t *p, uint16_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+void capture_send(void* parameter)
+{
+    // Static to keep the task within configMINIMAL_STACK_SIZE
+    static uint16_t samples[CAPTURE_BLOCK_SAMPLES];
+    static uint8_t packed[CAPTURE_PAYLOAD_MAX];
+    static uint8_t frame[CAPTURE_PAYLOAD_MAX + TELEMETRY_OVERHEAD];
+    uint8_t seq = 0;
+    uint8_t *p;
+    uint8_t i;
+    int16_t delta;
+    
+    while (1)
+    {
+        // Wakes up once there is a whole block
+        xStreamBufferReceive(capture_buffer, samples, CAPTURE_BLOCK_BYTES, 
+            portMAX_DELAY);
+        
+        p = packed;
+        *p++ = seq++;
+        p = capture_varint(p, capture_overruns());
+        p = capture_varint(p, samples[0]);
+        for (i = 1; i < CAPTURE_BLOCK_SAMPLES; i++)
+        {
+            // Zigzag encode the difference to the previous sample
+            delta = samples[i] - samples[i - 1];
+            p = capture_varint(p, ((uint16_t)delta << 1) ^ (delta >> 15));
+        }
+        uart_write(frame, telemetry_encode(frame, TELEMETRY_CAPTURE, packed, 
+            p - packed));
+    }
+    vTaskDelete(NULL);
+}
+
+ISR(PORTF_PORT_vect)
+{
+    static TickType_t last_press;
+    TickType_t now = xTaskGetTickCountFromISR();
+    
+    PORTF.INTFLAGS = PIN6_bm;
+    if ((TickType_t)(now - last_press) < pdMS_TO_TICKS(CAPTURE_DEBOUNCE_MS))
+    {
+        return;
+    }
+    last_press = now;
+    
+    if (capture_on)
+    {
+        capture_stop();
+        LOG1("capture stopped, %u samples dropped", capture_overruns());
+    }
+    else if (capture_start(CAPTURE_INPUT, CAPTURE_RATE_HZ))
+    {
+        LOG2("capture of input %u at %u Hz", CAPTURE_INPUT, CAPTURE_RATE_HZ);
+    }
+    else
+    {
+        LOG2("capture of input %u at %u Hz not possible", CAPTURE_INPUT, 
+            CAPTURE_RATE_HZ);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef CAPTURE_H
+#define	CAPTURE_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+
+/*
+ * Capture stream format
+ *
+ *      Samples are sent in blocks of CAPTURE_BLOCK_SAMPLES, each in a 
+ *      TELEMETRY_CAPTURE frame (see telemetry.h) with the payload
+ *          block sequence number, 1 byte, one more than in the previous block
+ *          overrun count, varint
+ *          first sample, varint
+ *          CAPTURE_BLOCK_SAMPLES - 1 differences to the previous sample,
+ *          zigzag varints
+ *      A varint holds 7 bits per byte, least significant first, with the top
+ *      bit set in all but the last byte. Zigzag maps 0, -1, 1, -2... to 
+ *      0, 1, 2, 3... so that small differences fit into one byte. The overrun
+ *      count is the total number of samples dropped since capture_start(),
+ *      a gap in the sequence numbers tells how many blocks were lost on the
+ *      way. tools/telemetry/capture2csv decodes the blocks.
+ */
+#define CAPTURE_BLOCK_SAMPLES   16
+// Sequence number, overrun count, first sample and the differences
+#define CAPTURE_PAYLOAD_MAX     (1 + 3 + 3 * CAPTURE_BLOCK_SAMPLES)
+
+/* Makes all required inital configurations for capture mode. */
+void capture_init(void);
+
+/* Pauses the ADC scan and starts capturing the given input (LDR, NTC, POT)
+ * rate_hz times per second to UART. Also callable from an interrupt. 
+ * Returns 0 without starting if the ADC cannot convert the input at that 
+ * rate (see adc_capture_rate_max()), 1 otherwise. */
+uint8_t capture_start(uint8_t input, uint16_t rate_hz);
+
+/* Stops capturing and resumes the ADC scan. Also callable from an 
+ * interrupt. */
+void capture_stop(void);
+
+/* Returns 1 while capturing. */
+uint8_t capture_active(void);
+
+/* Returns the number of samples dropped since capture_start(). */
+uint16_t capture_overruns(void);
+
+/* Called by the ADC interrupt with every result in capture mode. Sets woken
+ * if the UART task should run next. */
+void capture_sample_from_isr(uint16_t sample, BaseType_t *woken);
+
+/* Sends the captured samples via UART. Capture is toggled on and off with 
+ * the on-board button SW0. */
+void capture_send(void* parameter);
+
+#endif	/* CAPTURE_H */
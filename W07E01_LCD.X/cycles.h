@@ -0,0 +1,49 @@
+/*
+ * File:   cycles.h
+ * CPU cycle counter for timing short code sections on the target.
+ *
+ * The FreeRTOS tick timer TCB0 counts CPU clock cycles from 0 to its CCMP
+ * (configCPU_CLOCK_HZ / configTICK_RATE_HZ) and starts over every tick.
+ * cycles_since() undoes one wrap, so sections up to one tick, 1 ms, can
+ * be timed. Interrupts that run in between are included in the result.
+ */
+
+#ifndef CYCLES_H
+#define	CYCLES_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include "FreeRTOS.h"
+
+// Counts in one tick period, CCMP + 1
+#define CYCLES_PER_TICK         (configCPU_CLOCK_HZ / configTICK_RATE_HZ + 1)
+
+/* Current count of TCB0. The two bytes are read with interrupts off,
+ * an interrupt reading TCB0 between them would change the high byte
+ * latched in TEMP. */
+static inline uint16_t cycles_now(void)
+{
+    uint8_t sreg = SREG;
+    uint16_t count;
+
+    cli();
+    count = TCB0.CNT;
+    SREG = sreg;
+    return count;
+}
+
+/* Cycles from start (a cycles_now() value) to now. Only valid when less
+ * than one tick has passed. */
+static inline uint16_t cycles_since(uint16_t start)
+{
+    uint16_t now = cycles_now();
+
+    if (now < start)
+    {
+        now += CYCLES_PER_TICK;
+    }
+    return now - start;
+}
+
+#endif	/* CYCLES_H */
@@ -0,0 +1,92 @@
+/*
+ * File:   filter.c
+ * Fixed-point filters for smoothing ADC readings.
+ *
+ * All filters use only additions, comparisons and shifts, so they are cheap
+ * enough to run in the ADC interrupt. The worst case is FILTER_MEDIAN5, a
+ * copy and an insertion sort of five values.
+ */
+
+#include <stdint.h>
+#include "filter.h"
+
+// Fractional bits of the FILTER_IIR state. Keeps the output from getting 
+// stuck short of the input because of the shift.
+#define FILTER_IIR_FRAC 8
+
+// Median of the last n samples in the history
+static uint16_t filter_median(const struct filter *f, uint8_t n)
+{
+    uint16_t sorted[5];
+    uint16_t value;
+    uint8_t i;
+    uint8_t j;
+    
+    // The last n samples end just before index
+    for (i = 0; i < n; i++)
+    {
+        value = f->history[(f->index - 1 - i) & (FILTER_HISTORY - 1)];
+        // Insertion sort, at most 10 comparisons for 5 values
+        for (j = i; (j > 0) && (sorted[j - 1] > value); j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+    return sorted[n / 2];
+}
+
+void filter_init(struct filter *f, uint8_t type, uint8_t param)
+{
+    f->type = type;
+    f->param = param;
+    f->index = 0;
+    f->primed = 0;
+}
+
+uint16_t filter_apply(struct filter *f, uint16_t sample)
+{
+    uint8_t i;
+    uint8_t window;
+    
+    if (!f->primed)
+    {
+        // Start as if the input had always been at the first sample
+        for (i = 0; i < FILTER_HISTORY; i++)
+        {
+            f->history[i] = sample;
+        }
+        // Unsigned shift, a 13-bit sample times 8 does not fit in an int
+        f->sum = (uint16_t)sample << f->param;
+        f->iir = (int32_t)sample << FILTER_IIR_FRAC;
+        f->primed = 1;
+    }
+    
+    switch (f->type)
+    {
+        case FILTER_IIR:
+            f->iir += (((int32_t)sample << FILTER_IIR_FRAC) - f->iir) 
+                >> f->param;
+            // Round to the nearest integer
+            return (uint16_t)((f->iir + (1 << (FILTER_IIR_FRAC - 1))) 
+                >> FILTER_IIR_FRAC);
+            
+        case FILTER_AVERAGE:
+            // Replace the oldest sample of the window in the sum
+            window = 1 << f->param;
+            f->sum += sample - f->history[(f->index - window) & 
+                (FILTER_HISTORY - 1)];
+            f->history[f->index] = sample;
+            f->index = (f->index + 1) & (FILTER_HISTORY - 1);
+            return f->sum >> f->param;
+            
+        case FILTER_MEDIAN3:
+        case FILTER_MEDIAN5:
+            f->history[f->index] = sample;
+            f->index = (f->index + 1) & (FILTER_HISTORY - 1);
+            return filter_median(f, (f->type == FILTER_MEDIAN3) ? 3 : 5);
+            
+        default:
+            return sample;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef FILTER_H
+#define	FILTER_H
+
+#include <stdint.h>
+
+/*
+ * Filter types and their parameter
+ *
+ *      FILTER_NONE     Output follows the input
+ *      FILTER_IIR      First-order low-pass y += (x - y) / 2^param, 
+ *                      param 1...7. Time constant about 2^param samples.
+ *      FILTER_AVERAGE  Moving average of the last 2^param samples, 
+ *                      param 1...3
+ *      FILTER_MEDIAN3  Median of the last 3 samples, param not used
+ *      FILTER_MEDIAN5  Median of the last 5 samples, param not used
+ *
+ * Inputs up to 13 bits (8191) are supported. Every filter runs in a fixed 
+ * number of steps without division.
+ */
+#define FILTER_NONE     0
+#define FILTER_IIR      1
+#define FILTER_AVERAGE  2
+#define FILTER_MEDIAN3  3
+#define FILTER_MEDIAN5  4
+
+#define FILTER_HISTORY  8   // Largest window of FILTER_AVERAGE
+
+/* State of one filter. Use one per input. */
+struct filter
+{
+    uint8_t type;
+    uint8_t param;
+    uint8_t index;          // Next history slot to write
+    uint8_t primed;         // 0 until the first sample
+    uint16_t sum;           // FILTER_AVERAGE sum of the window
+    int32_t iir;            // FILTER_IIR output with FILTER_IIR_FRAC bits
+    uint16_t history[FILTER_HISTORY];
+};
+
+/* Sets up a filter of the given type. The first sample fills its history, so
+ * the output starts from the first sample instead of from zero. */
+void filter_init(struct filter *f, uint8_t type, uint8_t param);
+
+/* Feeds a new sample to the filter and returns the filtered value. */
+uint16_t filter_apply(struct filter *f, uint16_t sample);
+
+#endif	/* FILTER_H */
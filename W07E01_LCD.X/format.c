@@ -0,0 +1,84 @@
+/*
+ * File:   format.c
+ * Small string formatting functions to use instead of sprintf. 
+ * These write straight into the caller's buffer and do not need avr-libc's 
+ * vfprintf, which is big and needs a lot of stack.
+ */
+
+#include "format.h"
+
+// Powers of ten used by format_u16, largest first
+static const uint16_t powers_of_ten[] = { 10000, 1000, 100, 10 };
+
+char *format_str(char *dst, const char *src)
+{
+    while (*src)
+    {
+        *dst++ = *src++;
+    }
+    *dst = '\0';
+    return dst;
+}
+
+char *format_u16(char *dst, uint16_t value, uint8_t width)
+{
+    char digits[5];
+    uint8_t count = 0;
+    uint8_t i;
+    
+    // Find each digit by repeated subtraction, AVR has no divide instruction.
+    // At most 9 subtractions per digit.
+    for (i = 0; i < sizeof(powers_of_ten) / sizeof(powers_of_ten[0]); i++)
+    {
+        char digit = '0';
+        while (value >= powers_of_ten[i])
+        {
+            value -= powers_of_ten[i];
+            digit++;
+        }
+        // Skip leading zeros
+        if ((count > 0) || (digit != '0'))
+        {
+            digits[count++] = digit;
+        }
+    }
+    digits[count++] = '0' + (uint8_t)value; // Ones, also the only digit of 0
+    
+    // Right-align
+    while (width > count)
+    {
+        *dst++ = ' ';
+        width--;
+    }
+    for (i = 0; i < count; i++)
+    {
+        *dst++ = digits[i];
+    }
+    *dst = '\0';
+    return dst;
+}
+
+char *format_tenths(char *dst, int16_t value)
+{
+    char *p;
+    
+    if (value < 0)
+    {
+        *dst++ = '-';
+        value = -value;
+    }
+    // At least two digits, so that there is a digit before the point
+    p = format_u16(dst, (uint16_t)value, 0);
+    if (value < 10)
+    {
+        p[1] = '\0';
+        p[0] = p[-1];
+        p[-1] = '0';
+        p++;
+    }
+    // Move the last digit right and put the point in its place
+    p[1] = '\0';
+    p[0] = p[-1];
+    p[-1] = '.';
+    return p + 1;
+}
@@ -0,0 +1,21 @@
+#ifndef FORMAT_H
+#define	FORMAT_H
+
+#include <stdint.h>
+
+/* Copies src to dst. Returns a pointer to the terminating NUL in dst, so 
+ * that calls can be chained to build a string piece by piece. */
+char *format_str(char *dst, const char *src);
+
+/* Writes value as a decimal number to dst, right-aligned to width characters
+ * (padded with spaces, width 0 = no padding). Needs room for 
+ * max(width, 5) + 1 characters. Returns a pointer to the terminating NUL. */
+char *format_u16(char *dst, uint16_t value, uint8_t width);
+
+/* Writes a value in tenths as a decimal number with one decimal, for 
+ * example -5 as "-0.5". Needs room for 8 characters. Returns a pointer to 
+ * the terminating NUL. */
+char *format_tenths(char *dst, int16_t value);
+
+#endif	/* FORMAT_H */
+
@@ -19,6 +19,7 @@
  *   3      V0              LCD drive / contrast
  *   4      RS      PB4     Register Select (0 = instruction, 1 = data)
  *   5      RW      GND     Read/Write      (0 = write,       1 = read)
+ *                  (PB2)   ...when built with LCD_USE_BUSY_FLAG = 1
  *   6      ENABLE  PB3     Enable          (0 = disabled,    1 = process input)
  *   7-14   DATA    PD[0:7] Data lines
  *
@@ -26,124 +27,538 @@
  * expected to process input. Curiously, it will function when constantly
  * set as HIGH.
  * 
- * This implementation uses <util/delay.h> for microsecond delays. If this code
- * is to be used in an application that requires accurate timing of few
- * microseconds, this code should be rewritten.
+ * Bytes are not written to the bus by the caller. They are queued into a ring
+ * buffer and clocked out by the TCB1 interrupt with the required command
+ * delays in between (see "Asynchronous transmit engine" below), so writers
+ * never busy-wait the 40 us per byte. <util/delay.h> is only used for the
+ * enable pulse, which is 2 CPU cycles at 3,33 MHz.
+ *
+ * With RW tied to GND the driver cannot read the controller, so every byte is
+ * given the datasheet worst case execution time. If RW is wired to PB2 and
+ * LCD_USE_BUSY_FLAG is set to 1, the driver instead reads the busy flag (D7)
+ * when a typical controller is ready and then every LCD_BUSY_POLL_US, so 
+ * even a controller with a slow oscillator is never written while busy.
+ * tools/lcdsim (make bench) compares the two modes.
+ *
+ * E is pulsed by the CPU. A timer cannot do it on PB3 without taking the
+ * capture timer: the only timer output there is TCA0 WO3, which exists 
+ * only in split mode, and TCA0 runs in single mode as the capture sample
+ * clock (capture.c). TCA has no single-shot mode either. A TCB single-shot
+ * pulse would need E moved to PB4. The E pulse is therefore kept as short
+ * as the controller allows.
  */
 
 /******************************************************************************
  * PIN CONFIGURATION
  *****************************************************************************/
 #define F_CPU                   3333333
+// 1 = RW wired to LCD_RW_PIN, poll busy flag. 0 = RW tied to GND, fixed delays
+#ifndef LCD_USE_BUSY_FLAG
+#define LCD_USE_BUSY_FLAG       0
+#endif
+// 1 = time every burst and the LCD_TIMER interrupt for lcd_stats_get(), a
+// 32-bit addition per byte and a TCB0 read per interrupt. 0 = production 
+// build, last_burst_us and isr_cycles_max stay 0.
+#ifndef LCD_STATS
+#define LCD_STATS               0
+#endif
 // Control lines in PORTB
 #define LCD_E_PIN               PIN3_bm
 #define LCD_RS_PIN              PIN4_bm
+#define LCD_RW_PIN              PIN2_bm
 // CPS = Characters per second
 #define SCROLL_SPEED_CPS        5
 #define MANUFACTURER_TEXT       " DTEK0068 Embedded Microprocessor Systems "
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 // FreeRTOS
 #include "FreeRTOSConfig.h"
 #include "FreeRTOS.h"
 #include "task.h"
-#include "queue.h"
 
 #include "string.h"
-#include "stdio.h"
 #include "lcd.h"
 #include "adc.h"
+#include "format.h"
+#include "ntc.h"
+#include "log.h"
+#include "main.h"
+#if LCD_STATS
+#include "cycles.h"
+#endif
+
+/*
+ * LCD_BUS_EVENT - Marks a change on the LCD bus lines
+ *      Empty on target. The host timing emulator (tools/lcdsim) builds this
+ *      file with LCD_SIM defined and uses it to time-stamp RS/RW/E/D[0:7]
+ *      transitions against the ST7066U timing requirements.
+ */
+#ifdef LCD_SIM
+void lcd_sim_bus_event(void);
+#define LCD_BUS_EVENT()         lcd_sim_bus_event()
+#else
+#define LCD_BUS_EVENT()
+#endif
 
 /*
- * LCD_CMD_DELAY - Delay between LCD commands
+ * LCD_CMD_DELAY_US - Delay between LCD commands
  *      Documentation claims 37 us (verified to be too short) some state
  *      up to 43 us. Value of 40 microseconds appears to work reliably.
+ * LCD_CLEAR_DELAY_US - Execution time of "clear display" (> 1,52 ms)
+ * LCD_POWER_ON_DELAY_MS - Wait before the first command (> 40 ms after Vcc)
+ * LCD_INIT_DELAY_US - Delay after the function set commands of lcd_init()
+ *      The busy flag is not valid before the function set, so these get a 
+ *      fixed delay, long enough for the slowest oscillator (190 kHz, 53 us)
+ * LCD_CMD_POLL_US, LCD_CLEAR_POLL_US - First busy flag read (LCD_USE_BUSY_FLAG)
+ *      After a command or data and after "clear display", when a controller
+ *      with a typical or faster oscillator is ready. The typical 37 us and
+ *      1,52 ms plus a margin, since in the ISR pass that sends a byte the
+ *      busy flag read comes a few microseconds before the write.
+ * LCD_BUSY_POLL_US - Busy flag polling interval (LCD_USE_BUSY_FLAG = 1)
+ *      Only a slow controller is polled again. Each poll is one pass through
+ *      the LCD_TIMER ISR with a bus read, roughly 20 us at 3,33 MHz, so 
+ *      polling every 100 us takes at most a fifth of the CPU.
  * LCD_ENABLE_PULSE_DELAY - Length of Enable duty
  *      According to ST7066U datasheet, E pulse (Tpw) is at minimum 460 ns.
- *      Enable cycle time (Tc, time between E rising edges) must be >= 1200 ns.
- *          1/3,33 MHz is 0,3 us (-> 2x NOP) = 600 ns
- *          1/20 MHz is 50 ns    (-> 9x NOP) = 450 ns
- *      If timing has issues, the asm directive could be replaced with:
- *          asm volatile("nop\n\tnop\n\t"::)  ==>  _delay_us(1)
- *      It will also adapt to different F_CPU values
+ *      Enable cycle time (Tc, time between E rising edges) must be >= 1200 ns,
+ *      bytes are always much further apart than that.
+ *      _delay_us() rounds up to whole CPU cycles and adapts to F_CPU:
+ *          1/3,33 MHz is 0,3 us (-> 2 cycles) = 600 ns
+ *          1/20 MHz is 50 ns    (-> 10 cycles) = 500 ns
+ *      The same delay covers the data delay time tDDR (max 360 ns) of a
+ *      busy flag read.
  */
-#define LCD_CMD_DELAY()                 _delay_us(40)
-#define LCD_ENABLE_PULSE_DELAY()        _delay_us(1)
+#define LCD_CMD_DELAY_US                40
+#define LCD_CLEAR_DELAY_US              2000
+#define LCD_POWER_ON_DELAY_MS           100
+#define LCD_INIT_DELAY_US               100
+#define LCD_CMD_POLL_US                 42
+#define LCD_CLEAR_POLL_US               1600
+#define LCD_BUSY_POLL_US                100
+#define LCD_ENABLE_PULSE_DELAY()        _delay_us(0.46)
+// Only ever used from the LCD_TIMER ISR, so interrupts are already disabled
 #define LCD_ENABLE_PULSE()      \
 {                               \
-    taskENTER_CRITICAL();       \
     VPORTB.OUT |= LCD_E_PIN;    \
+    LCD_BUS_EVENT();            \
     LCD_ENABLE_PULSE_DELAY();   \
     VPORTB.OUT &= ~LCD_E_PIN;   \
-    taskEXIT_CRITICAL();        \
+    LCD_BUS_EVENT();            \
 }
-#define LCD_CMD_SEND(byte)      \
-{                               \
-    VPORTB.OUT &= ~LCD_RS_PIN;  \
-    VPORTD.OUT = (byte);        \
-    LCD_ENABLE_PULSE();         \
-    LCD_CMD_DELAY();            \
+
+/*
+ * Asynchronous transmit engine
+ *
+ *      Writers only push entries into lcd_tx_buffer and return. TCB1 runs in
+ *      periodic interrupt mode and its ISR clocks one entry out to the bus
+ *      per period. The period is reloaded after every byte with the
+ *      execution time of that byte, so the next byte goes out exactly when
+ *      the controller is ready for it. The timer is stopped whenever the
+ *      buffer runs empty.
+ *
+ *      Entry format:
+ *          Bits [7:0]  Byte to put on D[0:7]
+ *          Bit 8       LCD_TX_RS, data register (RS = 1)
+ *          Bit 9       LCD_TX_LONG, use LCD_CLEAR_DELAY_US execution time
+ *          Bit 10      LCD_TX_INIT, use LCD_INIT_DELAY_US, also with the
+ *                      busy flag, which is not valid before the function set
+ *
+ *      The buffer is single-producer (lcd_control task) single-consumer
+ *      (ISR). Head and tail are 8-bit and therefore atomic on AVR.
+ */
+#define LCD_TX_BUFFER_SIZE      64 // Must be a power of two
+#define LCD_TX_RS               0x0100
+#define LCD_TX_LONG             0x0200
+#define LCD_TX_INIT             0x0400
+#define LCD_TIMER               TCB1
+#define LCD_TIMER_vect          TCB1_INT_vect
+// Rounded up, so that no delay is shorter than asked for. The timer counts
+// from 0 up to CCMP, a period is CCMP + 1 ticks.
+#define LCD_US_TO_TICKS(us)     \
+    ((uint16_t)((((uint32_t)configCPU_CLOCK_HZ + 999) / 1000 * (us) + 999) \
+    / 1000))
+#define LCD_US_TO_CCMP(us)      (LCD_US_TO_TICKS(us) - 1)
+
+static volatile uint16_t lcd_tx_buffer[LCD_TX_BUFFER_SIZE];
+static volatile uint8_t lcd_tx_head = 0; // Next free slot, moved by writers
+static volatile uint8_t lcd_tx_tail = 0; // Next entry to send, moved by ISR
+#if LCD_USE_BUSY_FLAG
+// Read the busy flag before sending the next entry
+static uint8_t lcd_tx_poll = 0;
+#endif
+#if LCD_STATS
+// Timer ticks spent on the current and on the last completed burst of bytes
+static volatile uint32_t lcd_tx_burst_ticks = 0;
+static volatile uint32_t lcd_tx_last_burst_ticks = 0;
+// Longest LCD_TIMER interrupt so far, the time interrupts are off for it
+static volatile uint16_t lcd_tx_isr_cycles_max = 0;
+#endif
+
+/*
+ * Shadow framebuffer
+ *
+ *      Copy of the visible DDRAM contents, plus where the controller's 
+ *      address counter is. lcd_line_update() diffs new text against it and
+ *      only sends the cells that changed.
+ *
+ *      Each line has 40 cells of DDRAM of which the first 16 are visible.
+ *      Only those are shadowed, the display shift that would show the rest
+ *      moves both lines at once and is not used.
+ */
+#define LCD_LINES               2
+#define LCD_COLUMNS             16
+#define LCD_DDRAM_COLUMNS       40
+
+static char lcd_shadow[LCD_LINES][LCD_COLUMNS];
+static uint8_t lcd_cursor_line = 0;
+static uint8_t lcd_cursor_col = 0; // DDRAM column
+static struct lcd_stats lcd_stats_counters;
+
+/*
+ * Scrolling banner
+ *
+ *      MANUFACTURER_TEXT lives only in flash. Every scroll frame is a 16
+ *      character window into it, so a frame is just an offset: nothing is
+ *      copied to RAM until lcd_control needs the characters for the diff.
+ */
+#define LCD_BANNER_LENGTH       (sizeof(MANUFACTURER_TEXT) - 1)
+#define LCD_BANNER_MAX_INDEX    (LCD_BANNER_LENGTH - LCD_COLUMNS)
+
+static const __flash char lcd_banner[] = MANUFACTURER_TEXT;
+
+// Frame offsets are sent in the int8_t request argument
+_Static_assert(LCD_BANNER_LENGTH <= LCD_COLUMNS + 127, 
+    "MANUFACTURER_TEXT too long");
+
+/*
+ * LCD line mailboxes
+ *
+ *      Each line has a mailbox holding its newest requested contents.
+ *      lcd_request() applies a request to the mailbox and notifies
+ *      lcd_control, so producers never wait for the LCD. Requests that
+ *      arrive while lcd_control is busy or waiting for the next frame are
+ *      merged, and lcd_control only ever draws the newest contents.
+ *      Mailboxes are only touched by tasks, so suspending the scheduler is
+ *      enough to protect them and interrupts stay enabled.
+ *
+ *      A request is an opcode plus only the text it carries: LCD_OP_TEXT 
+ *      copies just the given characters into the line, so a producer can
+ *      update a value without resending its label. Unlike a queue or a 
+ *      message buffer, nothing is copied a second time on the way to 
+ *      lcd_control, and a superseded request is never drawn.
+ *
+ * LCD_FRAME_RATE_HZ - Maximum number of frames lcd_control draws per second
+ * LCD_STATS_LOG_MS - Interval of logging the bus traffic (LCD_STATS)
+ */
+#define LCD_FRAME_RATE_HZ       10
+#define LCD_STATS_LOG_MS        10000
+
+struct lcd_mailbox
+{
+    char text[LCD_COLUMNS];     // Newest contents, space padded
+    uint8_t dirty;
+};
+
+static struct lcd_mailbox lcd_mailboxes[LCD_LINES];
+
+/******************************************************************************
+ * Transmit engine
+ *****************************************************************************/
+static void lcd_tx_timer_init(void)
+{
+    LCD_TIMER.CCMP = LCD_US_TO_CCMP(LCD_CMD_DELAY_US);
+    LCD_TIMER.CTRLB = TCB_CNTMODE_INT_gc; // Periodic interrupt mode
+    LCD_TIMER.INTCTRL = TCB_CAPT_bm;
+    // Use CLK_PER, timer is enabled only while there is something to send
+    LCD_TIMER.CTRLA = TCB_CLKSEL_CLKDIV1_gc;
 }
-#define LCD_DATA_SEND(byte)     \
-{                               \
-    VPORTB.OUT |= LCD_RS_PIN;   \
-    VPORTD.OUT = (byte);        \
-    LCD_ENABLE_PULSE();         \
-    LCD_CMD_DELAY();            \
+
+// Queue one entry for transmission. Blocks (sleeping) only if the buffer
+// is full.
+static void lcd_tx_push(uint16_t entry)
+{
+    uint8_t next = (lcd_tx_head + 1) & (LCD_TX_BUFFER_SIZE - 1);
+    
+    while (next == lcd_tx_tail)
+    {
+        vTaskDelay(1); // Buffer full, let the ISR drain it
+    }
+    lcd_tx_buffer[lcd_tx_head] = entry;
+    lcd_tx_head = next;
+    
+    // Kick the timer if the ISR has stopped it. The previous byte has had
+    // at least its full execution time since the ISR only stops the timer
+    // one period after sending, so the first byte may go out right away.
+    if (!(LCD_TIMER.CTRLA & TCB_ENABLE_bm))
+    {
+        LCD_TIMER.CNT = 0;
+        LCD_TIMER.CCMP = LCD_US_TO_CCMP(1);
+        LCD_TIMER.CTRLA |= TCB_ENABLE_bm;
+    }
 }
 
-// Queue used for sending data to display on the LCD
-QueueHandle_t lcd_msg_queue;
+#if LCD_USE_BUSY_FLAG
+// Read the busy flag. D[0:7] must be released before RW goes high, since the
+// controller starts driving the bus as soon as a read is selected.
+static uint8_t lcd_busy(void)
+{
+    uint8_t busy;
+    
+    VPORTD.DIR = 0x00;
+    VPORTB.OUT &= ~LCD_RS_PIN;
+    VPORTB.OUT |= LCD_RW_PIN;
+    LCD_BUS_EVENT();
+    VPORTB.OUT |= LCD_E_PIN;
+    LCD_BUS_EVENT();
+    LCD_ENABLE_PULSE_DELAY(); // Also covers data delay time tDDR
+    busy = VPORTD.IN & 0x80;
+    VPORTB.OUT &= ~LCD_E_PIN;
+    LCD_BUS_EVENT();
+    VPORTB.OUT &= ~LCD_RW_PIN;
+    VPORTD.DIR = 0xFF;
+    LCD_BUS_EVENT();
+    
+    return busy;
+}
+#endif
 
-// Message format used in lcd_msg_queue: line number and text content
-struct LCD_message
+// Body of the LCD_TIMER interrupt, clocks out one entry
+static inline void lcd_tx_isr(void)
 {
-    uint8_t line_num;
-    char text[17];
-};
+    LCD_TIMER.INTFLAGS = TCB_CAPT_bm;
+#if LCD_STATS
+    lcd_tx_burst_ticks += LCD_TIMER.CCMP + 1;
+#endif
+    
+    // Nothing left to send, stop until lcd_tx_push() restarts the timer
+    if (lcd_tx_tail == lcd_tx_head)
+    {
+        LCD_TIMER.CTRLA &= ~TCB_ENABLE_bm;
+#if LCD_STATS
+        lcd_tx_last_burst_ticks = lcd_tx_burst_ticks;
+        lcd_tx_burst_ticks = 0;
+#endif
+        return;
+    }
+    
+#if LCD_USE_BUSY_FLAG
+    // Still executing the previous byte, look again after the poll interval
+    if (lcd_tx_poll && lcd_busy())
+    {
+        LCD_TIMER.CCMP = LCD_US_TO_CCMP(LCD_BUSY_POLL_US);
+        return;
+    }
+#endif
+    
+    uint16_t entry = lcd_tx_buffer[lcd_tx_tail];
+    lcd_tx_tail = (lcd_tx_tail + 1) & (LCD_TX_BUFFER_SIZE - 1);
+    
+    if (entry & LCD_TX_RS)
+    {
+        VPORTB.OUT |= LCD_RS_PIN;
+    }
+    else
+    {
+        VPORTB.OUT &= ~LCD_RS_PIN;
+    }
+    VPORTD.OUT = (uint8_t)entry;
+    LCD_BUS_EVENT();
+    LCD_ENABLE_PULSE();
+    
+#if LCD_USE_BUSY_FLAG
+    // Controller tells when it is done, ask first when a typical one is
+    lcd_tx_poll = !(entry & LCD_TX_INIT);
+    if (lcd_tx_poll)
+    {
+        LCD_TIMER.CCMP = (entry & LCD_TX_LONG) ? 
+            LCD_US_TO_CCMP(LCD_CLEAR_POLL_US) : 
+            LCD_US_TO_CCMP(LCD_CMD_POLL_US);
+        return;
+    }
+#endif
+    // Next interrupt when the controller has executed this byte
+    if (entry & LCD_TX_LONG)
+    {
+        LCD_TIMER.CCMP = LCD_US_TO_CCMP(LCD_CLEAR_DELAY_US);
+    }
+    else if (entry & LCD_TX_INIT)
+    {
+        LCD_TIMER.CCMP = LCD_US_TO_CCMP(LCD_INIT_DELAY_US);
+    }
+    else
+    {
+        LCD_TIMER.CCMP = LCD_US_TO_CCMP(LCD_CMD_DELAY_US);
+    }
+}
+
+// Interrupts stay off for the whole interrupt. Counted by hand from the 
+// AVRxt instruction timings, sending a byte with fixed delays takes about 
+// 45 cycles of body and 30 of entry and exit, some 75 cycles or 23 us at 
+// 3,33 MHz. The E pulse is 4 of them. A busy flag read adds about 20
+// cycles. LCD_STATS measures the body on the target.
+ISR(LCD_TIMER_vect)
+{
+#if LCD_STATS
+    // Register saving at the interrupt entry and exit is not included
+    uint16_t start = cycles_now();
+    uint16_t cycles;
+    
+    lcd_tx_isr();
+    cycles = cycles_since(start);
+    if (cycles > lcd_tx_isr_cycles_max)
+    {
+        lcd_tx_isr_cycles_max = cycles;
+    }
+#else
+    lcd_tx_isr();
+#endif
+}
 
 /******************************************************************************
  * Public functions
  *****************************************************************************/
-void lcd_write(char *str)
+// Send one character at the cursor and keep the shadow buffer in sync.
+// The address counter increments after every data write.
+static void lcd_putc(char c)
 {
-    while (*str)
+    if (lcd_cursor_col < LCD_COLUMNS)
+    {
+        lcd_shadow[lcd_cursor_line][lcd_cursor_col] = c;
+    }
+    lcd_tx_push(LCD_TX_RS | (uint8_t)c);
+    lcd_stats_counters.bytes_written++;
+    
+    // In 2-line mode the address counter goes from the end of one line to
+    // the beginning of the other (0x27 -> 0x40, 0x67 -> 0x00)
+    if (++lcd_cursor_col == LCD_DDRAM_COLUMNS)
     {
-        LCD_DATA_SEND(*str++);
+        lcd_cursor_col = 0;
+        lcd_cursor_line ^= 0x01;
     }
 }
 
-// Zero indexed positions
-// x        Line (even = line 0, odd = line 1)
-// y        Character position (0x00 ... 0x0F)
-void lcd_cursor_set(uint8_t x, uint8_t y)
+// Move the address counter to a DDRAM column of a line
+static void lcd_ddram_set(uint8_t line, uint8_t col)
 {
     // Set DDRAM address command is 0b1aaaaaaa (0x80)
     // Where 'a' is an address bit (7-bit address value).
-    // For 16x2, this is:
-    //      0x00 - 0x15 (line 1)
-    //      0x40 - 0x55 (line 2)
+    // For 40x2 DDRAM, this is:
+    //      0x00 - 0x27 (line 1)
+    //      0x40 - 0x67 (line 2)
     //
     // What this REALLY means is:
     // Bit 7        Set DDRAM address command bit (= 1)
     // Bit 6        Line bit (0 = line 1, 1 = line 2)
-    // Bit [5:4]    Undefined (keep as zero)
-    // Bits [3:0]   Char position (0x00 - 0x15)
+    // Bits [5:0]   Char position (0x00 - 0x27)
+    lcd_tx_push(0x80 | ((line & 0x01) << 6) | col);
+    lcd_stats_counters.bytes_written++;
+    
+    lcd_cursor_line = line & 0x01;
+    lcd_cursor_col = col;
+}
+
+void lcd_write(char *str)
+{
+    while (*str)
+    {
+        lcd_putc(*str++);
+    }
+}
 
+// Zero indexed positions
+// x        Line (even = line 0, odd = line 1)
+// y        Visible character position (0x00 ... 0x0F)
+void lcd_cursor_set(uint8_t x, uint8_t y)
+{
     // Cap at 0x0F
     y = y > 0x0F ? 0x0F : y;
-    // Shift odd/even (line #) to line bit position (bit 6)
-    LCD_CMD_SEND(0x80 | ((x & 0x01) << 6) | y);
+    lcd_ddram_set(x, y);
 }
 
 
 void lcd_clear(void)
 {
-    // Send "clear screen" command
-    LCD_CMD_SEND(0b00000001);
-    // Wait until clear is completed (>1,52 ms)
-    vTaskDelay(pdMS_TO_TICKS(2));
+    // Send "clear screen" command, the transmit engine holds off the next
+    // byte until clear is completed (>1,52 ms)
+    lcd_tx_push(LCD_TX_LONG | 0b00000001);
+    lcd_stats_counters.bytes_written++;
+    
+    memset(lcd_shadow, ' ', sizeof(lcd_shadow));
+    lcd_cursor_line = 0;
+    lcd_cursor_col = 0;
+}
+
+void lcd_line_update(uint8_t line, const char *text)
+{
+    char new_text[LCD_COLUMNS];
+    char *shadow = lcd_shadow[line & 0x01];
+    uint8_t col;
+    
+    // Pad to full line width with spaces to clear old writing
+    for (col = 0; col < LCD_COLUMNS; col++)
+    {
+        new_text[col] = *text ? *text++ : ' ';
+    }
+    
+    // A full rewrite would be one cursor set and a character per column
+    lcd_stats_counters.bytes_requested += LCD_COLUMNS + 1;
+    
+    col = 0;
+    while (col < LCD_COLUMNS)
+    {
+        if (new_text[col] == shadow[col])
+        {
+            col++;
+            continue;
+        }
+        
+        // Start of a changed run, jump there unless already in place
+        if ((lcd_cursor_line != (line & 0x01)) || 
+            (lcd_cursor_col != col))
+        {
+            lcd_ddram_set(line, col);
+        }
+        
+        // Write the run. A single unchanged cell between two changed ones
+        // is rewritten, as it costs the same one byte as a cursor jump.
+        while (col < LCD_COLUMNS)
+        {
+            if ((new_text[col] == shadow[col]) && 
+                ((col + 1 >= LCD_COLUMNS) || 
+                    (new_text[col + 1] == shadow[col + 1])))
+            {
+                break;
+            }
+            lcd_putc(new_text[col++]);
+        }
+    }
+}
+
+// Copy the 16 character banner window starting at offset into dst,
+// padded with spaces if the banner ends before the window does
+static void lcd_banner_window(char *dst, uint8_t offset)
+{
+    const __flash char *src = &lcd_banner[offset];
+    uint8_t col;
+    
+    for (col = 0; col < LCD_COLUMNS; col++)
+    {
+        dst[col] = (offset + col < LCD_BANNER_LENGTH) ? *src++ : ' ';
+    }
+}
+
+void lcd_stats_get(struct lcd_stats *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = lcd_stats_counters;
+#if LCD_STATS
+    stats->last_burst_us = lcd_tx_last_burst_ticks * 1000 / 
+        (configCPU_CLOCK_HZ / 1000);
+    stats->isr_cycles_max = lcd_tx_isr_cycles_max;
+#endif
+    taskEXIT_CRITICAL();
 }
 
 /*
@@ -160,17 +575,25 @@ void lcd_init(void)
 {
     // Control      lines
     //  LCD_E_PIN     E       
-    //  -             RW      Read/Write (0 = Write, 1 = Read)
+    //  LCD_RW_PIN    RW      Read/Write (0 = Write, 1 = Read)
     //  LCD_RS_PIN    RS      Register select
-    // Note: RW is permanently grounded - this implementation does not read.
+    // Note: Unless LCD_USE_BUSY_FLAG is set, RW is permanently grounded and
+    // this implementation does not read.
     PORTB.DIRSET = (LCD_E_PIN | LCD_RS_PIN);
+#if LCD_USE_BUSY_FLAG
+    PORTB.OUTCLR = LCD_RW_PIN; // Write
+    PORTB.DIRSET = LCD_RW_PIN;
+#endif
     
     // Set PORTD as out
     PORTD.DIRSET = 0xFF;
+    
+    // All bus traffic from here on goes through the transmit engine
+    lcd_tx_timer_init();
     /*
      * Display will be busy for 40 ms after Vcc has stabilized > 4.5 V
      */
-    vTaskDelay(pdMS_TO_TICKS(100));
+    vTaskDelay(pdMS_TO_TICKS(LCD_POWER_ON_DELAY_MS));
 
     /*
      * 1) Function set
@@ -181,15 +604,18 @@ void lcd_init(void)
      *
      *      Send [00] [00111100] (2 display lines, 5x11 dots)
      *      Wait > 37 us
+     *
+     * The busy flag cannot be read until the function set is done, both
+     * are given the fixed LCD_INIT_DELAY_US.
      */
-    LCD_CMD_SEND(0b00111100);   // 8-bit data, 2 display lines, 5x11 dots
+    lcd_tx_push(LCD_TX_INIT | 0b00111100); // 8-bit data, 2 lines, 5x11 dots
 
     /*
      *  2) Repeat step 1
      *      Send [00] [00111100]
      *      Wait > 37 us
      */
-    LCD_CMD_SEND(0b00111100);   // 8-bit data, 2 display lines, 5x11 dots
+    lcd_tx_push(LCD_TX_INIT | 0b00111100); // 8-bit data, 2 lines, 5x11 dots
 
     /*
      *  3) Display ON/OFF
@@ -201,7 +627,7 @@ void lcd_init(void)
      *      Send [00] [00001100] (Display ON, cursor and blink OFF)
      *      Wait > 37 us
      */
-    LCD_CMD_SEND(0b00001100);   // Display ON, cursor and blink OFF
+    lcd_tx_push(0b00001100);   // Display ON, cursor and blink OFF
 
     /*
      *  4) Display clear
@@ -227,66 +653,153 @@ void lcd_init(void)
      * on each write. I = 0 is likely reserved for right-to-left writing
      * systems...
      */
-    LCD_CMD_SEND(0b00000110);
+    lcd_tx_push(0b00000110);
 }
 
-void lcd_msg_queue_init(void)
+void lcd_mailbox_init(void)
 {
-    // Create new msg_queue
-    lcd_msg_queue = xQueueCreate(2, sizeof(struct LCD_message));
+    uint8_t line;
+    
+    for (line = 0; line < LCD_LINES; line++)
+    {
+        memset(lcd_mailboxes[line].text, ' ', LCD_COLUMNS);
+        lcd_mailboxes[line].dirty = 0;
+    }
+}
+
+void lcd_request(uint8_t op, uint8_t line, int8_t arg, const char *text)
+{
+    struct lcd_mailbox *box = &lcd_mailboxes[line & 0x01];
+    size_t len = text ? strnlen(text, LCD_COLUMNS) : 0;
+    
+    vTaskSuspendAll();
+    switch (op)
+    {
+        case LCD_OP_LINE:
+            // Whole line, pad the rest with spaces
+            memset(box->text, ' ', LCD_COLUMNS);
+            memcpy(box->text, text, len);
+            break;
+            
+        case LCD_OP_TEXT:
+            // Overwrite only from the given column on
+            if ((uint8_t)arg < LCD_COLUMNS)
+            {
+                if (len > (size_t)(LCD_COLUMNS - arg))
+                {
+                    len = LCD_COLUMNS - arg;
+                }
+                memcpy(&box->text[arg], text, len);
+            }
+            break;
+            
+        case LCD_OP_BANNER:
+            // Banner window starting at offset arg
+            lcd_banner_window(box->text, (uint8_t)arg);
+            break;
+    }
+    box->dirty = 1;
+    xTaskResumeAll();
+    
+    xTaskNotifyGive(lcd_ctrl_handle);
 }
 
 void lcd_control(void* parameter)
 {
     lcd_init(); // First initialize LCD
      
-    struct LCD_message msg;
-    char space[1] = " ";
+    // Contents of each line as of the last frame
+    char lines[LCD_LINES][LCD_COLUMNS + 1];
+    uint8_t redraw;
+    uint8_t line;
+#if LCD_STATS
+    struct lcd_stats stats;
+    uint16_t isr_cycles_logged = 0;
+    uint32_t requested_logged = 0;
+    uint32_t written_logged = 0;
+    TickType_t stats_logged = xTaskGetTickCount();
+#endif
+    
+    memset(lines, ' ', sizeof(lines));
+    lines[0][LCD_COLUMNS] = '\0';
+    lines[1][LCD_COLUMNS] = '\0';
     
     // 200 ms delay before entering superloop
     vTaskDelay(200 / portTICK_PERIOD_MS);
     while (1)
     {
-        // Wait until new message is available and receive it
-        xQueueReceive(lcd_msg_queue, (void *)&msg, portMAX_DELAY); 
-        // Set cursor at the beginning of the correct line
-        lcd_cursor_set(msg.line_num, 0);
+        // Sleep until some mailbox has new contents
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        // Take the newest contents of the changed lines
+        redraw = 0;
+        vTaskSuspendAll();
+        for (line = 0; line < LCD_LINES; line++)
+        {
+            struct lcd_mailbox *box = &lcd_mailboxes[line];
+            
+            if (box->dirty)
+            {
+                memcpy(lines[line], box->text, LCD_COLUMNS);
+                box->dirty = 0;
+                redraw |= (1 << line);
+            }
+        }
+        xTaskResumeAll();
+        
+        // Write only the characters that differ from what is on the LCD
+        for (line = 0; line < LCD_LINES; line++)
+        {
+            if (redraw & (1 << line))
+            {
+                lcd_line_update(line, lines[line]);
+            }
+        }
         
-        // Fill too short message string with end spaces to clear old writing
-        while (strlen(msg.text) < 16)
+#if LCD_STATS
+        // Longest time the LCD has kept interrupts off
+        lcd_stats_get(&stats);
+        if (stats.isr_cycles_max > isr_cycles_logged)
         {
-            strncat(msg.text, space, 1); 
+            isr_cycles_logged = stats.isr_cycles_max;
+            LOG1("LCD interrupt took %u cycles", isr_cycles_logged);
         }
         
-        // Write the text on LCD
-        lcd_write(msg.text);
+        // Bytes sent against full line rewrites, at most 10 frames of two
+        // 17 byte lines per second, so the counts of an interval fit
+        if ((TickType_t)(xTaskGetTickCount() - stats_logged) >= 
+            pdMS_TO_TICKS(LCD_STATS_LOG_MS))
+        {
+            stats_logged = xTaskGetTickCount();
+            LOG2("LCD wrote %u bytes, full rewrites would have been %u", 
+                (uint16_t)(stats.bytes_written - written_logged), 
+                (uint16_t)(stats.bytes_requested - requested_logged));
+            written_logged = stats.bytes_written;
+            requested_logged = stats.bytes_requested;
+        }
+#endif
+        
+        // Requests arriving during this wait are merged into the next frame
+        vTaskDelay(pdMS_TO_TICKS(1000 / LCD_FRAME_RATE_HZ));
     }
     vTaskDelete(NULL);
 }
 
 void lcd_scrolling_text(void* parameter)
 {
-    struct LCD_message msg;
-    msg.line_num = 1; // Use lower line
-    
-    char man_text[] = MANUFACTURER_TEXT; 
-    size_t text_length = strlen(man_text);
-    
     // If the manufacturer text length is shorter than or 16 characters, 
     // there is no need to scroll the text and this task can be deleted
     // Or also if scroll speed has been defined as 0.
-    if ((text_length <= 16) || (SCROLL_SPEED_CPS <= 0))
+    if ((LCD_BANNER_LENGTH <= LCD_COLUMNS) || (SCROLL_SPEED_CPS <= 0))
     {
         // Send the text to displaying task before of course
-        memcpy(msg.text, man_text, 16);
-        xQueueSend(lcd_msg_queue, (void *)&msg, 10);
+        lcd_request(LCD_OP_BANNER, 1, 0, NULL);
         vTaskDelete(NULL);
     }
         
     // Scroll direction. 1: left to right, -1: right to left
     int8_t scroll_dir = 1; 
-    size_t i = 0;
-    size_t max_index = text_length - 16;
+    uint8_t i = 0;
     
     // 200 ms delay before entering superloop
     vTaskDelay(200 / portTICK_PERIOD_MS); 
@@ -296,7 +809,7 @@ void lcd_scrolling_text(void* parameter)
     for (;; i += scroll_dir)
     {    
         // Change scroll direction if necessary
-        if (i == max_index)
+        if (i == LCD_BANNER_MAX_INDEX)
         {
             scroll_dir = -1; // Leftwards
         }     
@@ -305,11 +818,9 @@ void lcd_scrolling_text(void* parameter)
             scroll_dir = 1; // Rightwards
         }
          
-        // Update the text to send: next 16 characters starting from the
-        // current index
-        memcpy(msg.text, &man_text[i], 16);
-        // Send the message via lcd_msg_queue
-        xQueueSend(lcd_msg_queue, (void *)&msg, portMAX_DELAY);
+        // Show the next 16 characters starting from the current index. 
+        // lcd_control reads them straight from flash.
+        lcd_request(LCD_OP_BANNER, 1, (int8_t)i, NULL);
         // Wait before scrolling again 
         vTaskDelay((1000 / SCROLL_SPEED_CPS) / portTICK_PERIOD_MS);
     } 
@@ -318,11 +829,11 @@ void lcd_scrolling_text(void* parameter)
 
 void lcd_adc_report(void* parameter)
 {
-    struct LCD_message msg;
-    msg.line_num = 0; // Use upper line
+    char text[LCD_COLUMNS + 1];
 
     uint16_t ldr_reading;
     uint16_t ntc_reading;
+    int16_t ntc_temp;
     uint16_t pot_reading;
     
     // 200 ms delay before entering superloop
@@ -330,22 +841,32 @@ void lcd_adc_report(void* parameter)
     while (1)
     {  
         /* LDR */
-        ldr_reading = adc_read(LDR); // Take the reading
-        sprintf(msg.text, "LDR value: %u ", ldr_reading); // Format to string
-        xQueueSend(lcd_msg_queue, (void *)&msg, portMAX_DELAY); // Send to queue    
+        ldr_reading = adc_get(LDR); // Take the latest reading
+        format_u16(format_str(text, "LDR value: "), ldr_reading, 0); // Format
+        lcd_request(LCD_OP_LINE, 0, 0, text); // Send to upper line
         vTaskDelay(660 / portTICK_PERIOD_MS); // Wait 660 ms
         // ...Repeat these steps with NTC and POT...
         
         /* NTC */
-        ntc_reading = adc_read(NTC);
-        sprintf(msg.text, "NTC value: %u ", ntc_reading); 
-        xQueueSend(lcd_msg_queue, (void *)&msg, portMAX_DELAY);
+        ntc_reading = adc_get(NTC);
+        ntc_temp = ntc_temperature(ntc_reading);
+        if (ntc_temp == NTC_OUT_OF_RANGE)
+        {
+            format_str(text, "NTC out of range");
+        }
+        else
+        {
+            format_str(format_tenths(format_str(text, "NTC temp: "), 
+                ntc_temp), "C");
+        }
+        lcd_request(LCD_OP_LINE, 0, 0, text);
         vTaskDelay(660 / portTICK_PERIOD_MS);
         
         /* POTENTIOMETER */
-        pot_reading = adc_read(POT);
-        sprintf(msg.text, "POT value: %u", pot_reading); 
-        xQueueSend(lcd_msg_queue, (void *)&msg, portMAX_DELAY);
+        pot_reading = adc_to_10bit(POT, adc_get(POT));
+        format_u16(format_str(text, "POT value: "), pot_reading, 0);
+        lcd_request(LCD_OP_LINE, 0, 0, text);
+        LOG_STACK("lcd_adc"); // Runs on configMINIMAL_STACK_SIZE
         vTaskDelay(660 / portTICK_PERIOD_MS);
     }
     vTaskDelete(NULL);
@@ -13,10 +13,24 @@
 #define LCD_LINE0       0
 #define LCD_LINE1       1
 
+// Request opcodes for lcd_request()
+#define LCD_OP_LINE     0   // Replace the whole line, padded with spaces
+#define LCD_OP_TEXT     1   // Overwrite text starting from column arg
+#define LCD_OP_BANNER   2   // Scrolling banner window at offset arg
+
 
 #ifdef	__cplusplus
 extern "C" {
 #endif
+
+/* LCD bus traffic counters, see lcd_stats_get() */
+struct lcd_stats
+{
+    uint32_t bytes_requested;   // Bytes full line rewrites would have sent
+    uint32_t bytes_written;     // Bytes actually sent to the controller
+    uint32_t last_burst_us;     // Bus time of the last burst (e.g. a line)
+    uint16_t isr_cycles_max;    // Longest transmit interrupt in CPU cycles
+};
     
 /*
  * lcd_init()
@@ -29,6 +43,8 @@ void lcd_init(void);
  * lcd_write()
  *
  *      Writes the given string to current cursor position.
+ *      Returns as soon as the bytes are queued (blocks only when the
+ *      transmit buffer is full). Must only be called from lcd_control.
  */
 void lcd_write(char *str);
 
@@ -44,22 +60,55 @@ void lcd_cursor_set(uint8_t x, uint8_t y);
 /*
  * lcd_clear()
  *
- *      SLOW! Takes 2 milliseconds. Resets cursor position to (0, 0).
+ *      Resets cursor position to (0, 0). Queued like any other command, but
+ *      the controller stays busy for 2 milliseconds after it is sent.
  */
 void lcd_clear(void);
 
-/* Initialize lcd_msg_queue. */
-void lcd_msg_queue_init(void);
+/*
+ * lcd_line_update()
+ *
+ *      Shows text (padded with spaces to 16 characters) on the given line.
+ *      Only the cells that differ from the current display contents are
+ *      written, with as few cursor jumps as possible.
+ */
+void lcd_line_update(uint8_t line, const char *text);
+
+/*
+ * lcd_stats_get()
+ *
+ *      Copies the bus traffic counters into stats. last_burst_us is the
+ *      time from the first byte of a burst to the controller finishing the
+ *      last one, which makes it possible to compare line update times of the
+ *      fixed delay and busy flag (LCD_USE_BUSY_FLAG) builds. 
+ *      isr_cycles_max is the longest transmit interrupt, the longest time
+ *      the LCD keeps interrupts off. Both are only measured when lcd.c is
+ *      built with LCD_STATS, otherwise they are 0.
+ */
+void lcd_stats_get(struct lcd_stats *stats);
+
+/* Initialize the LCD line mailboxes. */
+void lcd_mailbox_init(void);
+
+/*
+ * lcd_request()
+ *
+ *      Applies a request (LCD_OP_*) to the mailbox of the line and wakes
+ *      up lcd_control. Never blocks. Requests sent faster than the LCD
+ *      frame rate are merged, only the newest line contents get drawn.
+ *      text may be NULL for LCD_OP_BANNER.
+ */
+void lcd_request(uint8_t op, uint8_t line, int8_t arg, const char *text);
 
-/* Controls the cursor position and shows whatever text it 
- * receives via lcd_msg_queue on the LCD */
+/* Controls the cursor position and shows the newest contents of the 
+ * line mailboxes on the LCD */
 void lcd_control(void* parameter);
 
-/* Provides the lower line "scrolling text" to lcd_control via the queue */
+/* Provides the lower line "scrolling text" to lcd_control */
 void lcd_scrolling_text(void* parameter);
 
 /* Provides the upper line LDR, NTC and potentiometer 
- * value reports to lcd_control via the queue */
+ * value reports to lcd_control */
 void lcd_adc_report(void* parameter);
 
 #ifdef	__cplusplus
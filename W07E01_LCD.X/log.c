@@ -0,0 +1,175 @@
+/*
+ * File:   log.c
+ * Tokenized deferred logging, see log.h for the record format.
+ *
+ * A LOG call only copies the token and the raw arguments into a RAM ring
+ * buffer and notifies log_send. Formatting happens on the host. log_send 
+ * sleeps until it is notified, then takes every complete record out of the
+ * buffer and ships them in one TELEMETRY_LOG frame whenever nothing more
+ * important runs. A burst of LOG calls wakes it only once, because the 
+ * notifications just add up until it runs.
+ *
+ * Writers can be both tasks and interrupts. AVR has no compare-and-swap, 
+ * so a writer keeps interrupts off while it copies its record, at most
+ * 9 bytes. log_send is the only reader and needs no lock: a record 
+ * becomes visible only after it is complete. Set LOG_TIMING in log.h to 
+ * find out how long interrupts stay off.
+ */
+
+/*
+ * LOG_BUFFER_SIZE  - Ring buffer size in bytes, must be a power of two
+ */
+#define LOG_BUFFER_SIZE         128
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "log.h"
+#include "uart.h"
+#include "telemetry.h"
+#if LOG_TIMING
+#include "cycles.h"
+#endif
+
+#define LOG_MASK                (LOG_BUFFER_SIZE - 1)
+// Record that tells the number of dropped records
+#define LOG_DROPPED_BYTES       5
+
+// head is written by log_write() with interrupts off, tail by log_send()
+static uint8_t log_buffer[LOG_BUFFER_SIZE];
+static volatile uint8_t log_head;
+static volatile uint8_t log_tail;
+static volatile uint16_t log_dropped;
+// Set once log_send runs, notified by log_write()
+static TaskHandle_t log_task;
+#if LOG_TIMING
+static uint16_t log_write_cycles_max;
+#endif
+
+void log_write(uint8_t args, uint16_t token, uint16_t a, uint16_t b, 
+    uint16_t c)
+{
+    uint16_t arg[LOG_ARGS_MAX] = {a, b, c};
+    uint8_t head;
+#if LOG_TIMING
+    uint16_t start;
+    uint16_t cycles;
+#endif
+    
+    // taskENTER_CRITICAL() saves the interrupt state, so this also works
+    // inside interrupts
+    taskENTER_CRITICAL();
+#if LOG_TIMING
+    start = cycles_now();
+#endif
+    head = log_head;
+    // One byte always stays empty to tell a full buffer from an empty one
+    if (((log_tail - head - 1) & LOG_MASK) < 3 + 2 * args)
+    {
+        log_dropped++;
+    }
+    else
+    {
+        log_buffer[head] = LOG_RECORD | args;
+        head = (head + 1) & LOG_MASK;
+        log_buffer[head] = token & 0xFF;
+        head = (head + 1) & LOG_MASK;
+        log_buffer[head] = token >> 8;
+        head = (head + 1) & LOG_MASK;
+        for (uint8_t i = 0; i < args; i++)
+        {
+            log_buffer[head] = arg[i] & 0xFF;
+            head = (head + 1) & LOG_MASK;
+            log_buffer[head] = arg[i] >> 8;
+            head = (head + 1) & LOG_MASK;
+        }
+        log_head = head;
+    }
+    
+    // The FromISR version is safe from tasks too: interrupts are off here,
+    // and on this port that is all its interrupt mask does. No yield is 
+    // needed, log_send has the lowest priority and runs when its turn comes.
+    if (log_task)
+    {
+        vTaskNotifyGiveFromISR(log_task, NULL);
+    }
+#if LOG_TIMING
+    cycles = cycles_since(start);
+    if (cycles > log_write_cycles_max)
+    {
+        log_write_cycles_max = cycles;
+    }
+#endif
+    taskEXIT_CRITICAL();
+}
+
+void log_send(void* parameter)
+{
+    // Static to keep the task within configMINIMAL_STACK_SIZE. The records
+    // take at most LOG_BUFFER_SIZE - 1 bytes, so they and the dropped 
+    // record always fit into one frame.
+    static uint8_t payload[LOG_BUFFER_SIZE - 1 + LOG_DROPPED_BYTES];
+    static uint8_t frame[sizeof(payload) + TELEMETRY_OVERHEAD];
+    uint16_t dropped;
+    uint8_t head;
+    uint8_t len;
+#if LOG_TIMING
+    uint16_t cycles_logged = 0;
+    uint16_t cycles;
+#endif
+    
+    log_task = xTaskGetCurrentTaskHandle();
+    
+    // All tasks were created before the scheduler started, heap_1 never 
+    // gives memory back, so this is the final amount
+    LOG1("%u bytes of heap never used", xPortGetFreeHeapSize());
+    
+    while (1)
+    {
+        // Records written before log_task was set gave no notification, so
+        // sleep only when there is nothing to send. A record written after
+        // the check leaves a notification pending and the take returns.
+        if ((log_tail == log_head) && !log_dropped)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        
+#if LOG_TIMING
+        taskENTER_CRITICAL();
+        cycles = log_write_cycles_max;
+        taskEXIT_CRITICAL();
+        if (cycles > cycles_logged)
+        {
+            cycles_logged = cycles;
+            LOG1("log_write took up to %u cycles", cycles);
+        }
+#endif
+        
+        // Copy out everything complete so far, then free the space
+        head = log_head;
+        for (len = 0; log_tail != head; len++)
+        {
+            payload[len] = log_buffer[log_tail];
+            log_tail = (log_tail + 1) & LOG_MASK;
+        }
+        
+        taskENTER_CRITICAL();
+        dropped = log_dropped;
+        log_dropped = 0;
+        taskEXIT_CRITICAL();
+        if (dropped)
+        {
+            payload[len++] = LOG_RECORD | 1;
+            payload[len++] = 0;
+            payload[len++] = 0;
+            payload[len++] = dropped & 0xFF;
+            payload[len++] = dropped >> 8;
+        }
+        
+        if (len)
+        {
+            uart_write(frame, telemetry_encode(frame, TELEMETRY_LOG, payload, 
+                len));
+        }
+    }
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,82 @@
+#ifndef LOG_H
+#define	LOG_H
+
+#include <stdint.h>
+
+// 0 removes all LOG calls at compile time
+#define LOG_ENABLE 1
+// 1 times log_write() with cycles.h and logs its longest run
+#define LOG_TIMING 0
+
+/*
+ * Log record format
+ *
+ *      LOG_RECORD | number of arguments (0...3)
+ *      format string token, 2 bytes, little-endian
+ *      arguments, 2 bytes each, little-endian
+ *
+ *      The records are sent in TELEMETRY_LOG frames (telemetry.h), one or
+ *      more whole records per frame, so they cannot be mixed up with the
+ *      text reports and other frames on the same UART. The token is the 
+ *      flash address of the format string, which is never sent. 
+ *      tools/logexpand looks the strings up from the symbol table of the ELF
+ *      file (the log_fmt.* symbols) and prints the messages. A record with 
+ *      token 0 tells how many records were dropped because the buffer was 
+ *      full.
+ */
+#define LOG_RECORD      0xF0
+#define LOG_ARGS_MAX    3
+
+#if LOG_ENABLE
+
+// Places the format string in flash and gives its address as the token
+#define LOG_TOKEN(fmt) \
+    ({ \
+        static const __flash char log_fmt[] = fmt; \
+        (uint16_t)(uintptr_t)log_fmt; \
+    })
+
+/* Logs a message with up to three 16-bit arguments. The format string is 
+ * expanded on the host, so only %d, %i, %u, %x, %X, %o and %c (with flags 
+ * and width) are supported. Callable from tasks and interrupts, which it 
+ * keeps off while it copies the record, see LOG_TIMING. The message is 
+ * dropped if the log buffer is full. */
+#define LOG0(fmt)               log_write(0, LOG_TOKEN(fmt), 0, 0, 0)
+#define LOG1(fmt, a)            log_write(1, LOG_TOKEN(fmt), (a), 0, 0)
+#define LOG2(fmt, a, b)         log_write(2, LOG_TOKEN(fmt), (a), (b), 0)
+#define LOG3(fmt, a, b, c)      log_write(3, LOG_TOKEN(fmt), (a), (b), (c))
+
+/* Logs the stack the calling task has never used whenever it reaches a new
+ * low, so the last such message tells the headroom of the task. name is a 
+ * string literal. Needs task.h and INCLUDE_uxTaskGetStackHighWaterMark. */
+#define LOG_STACK(name) \
+    do \
+    { \
+        static UBaseType_t log_stack_low = ~(UBaseType_t)0; \
+        UBaseType_t left = uxTaskGetStackHighWaterMark(NULL); \
+        if (left < log_stack_low) \
+        { \
+            log_stack_low = left; \
+            LOG1("stack of " name ": %u bytes never used", left); \
+        } \
+    } while (0)
+
+#else
+
+#define LOG0(fmt)               ((void)0)
+#define LOG1(fmt, a)            ((void)0)
+#define LOG2(fmt, a, b)         ((void)0)
+#define LOG3(fmt, a, b, c)      ((void)0)
+#define LOG_STACK(name)         ((void)0)
+
+#endif
+
+/* Copies a log record into the log buffer. Use the LOG macros instead. */
+void log_write(uint8_t args, uint16_t token, uint16_t a, uint16_t b, 
+    uint16_t c);
+
+/* Sends the log buffer via UART when log_write() notifies it. Runs at the
+ * lowest priority, so logging does not delay the other tasks. */
+void log_send(void* parameter);
+
+#endif	/* LOG_H */
@@ -21,20 +21,25 @@
 #include "dummy.h"
 #include "lcd.h"
 #include "uart.h"
+#include "capture.h"
+#include "log.h"
 
 TaskHandle_t bl_ctrl_handle;
 TaskHandle_t bl_adj_handle;
+TaskHandle_t lcd_ctrl_handle;
 
 int main(void)
 {    
     PORTF.OUTSET = PIN5_bm; // Set PF5 high (onboard LED off)
     PORTF.DIRSET = PIN5_bm; // Set PF5 as out
     
-    // Initialization code of UART, ADC, LCD backlight and message queue
+    // Initialization code of UART, ADC, LCD backlight, line mailboxes and 
+    // capture mode
     uart_init();
     adc_init(); 
     backlight_init();
-    lcd_msg_queue_init();
+    lcd_mailbox_init();
+    capture_init();
     
     /* Task creation */       
     xTaskCreate(
@@ -43,7 +48,7 @@ int main(void)
     
     xTaskCreate(
         dummy, "dummy", configMINIMAL_STACK_SIZE, NULL, 
-        configMAX_PRIORITIES - 1, NULL); // Highest priority    
+        tskIDLE_PRIORITY, NULL);    
     
     xTaskCreate(
         backlight_control, "bl_ctrl", configMINIMAL_STACK_SIZE, NULL, 
@@ -51,19 +56,27 @@ int main(void)
     
     xTaskCreate(
         lcd_control, "lcd_ctrl", configMINIMAL_STACK_SIZE, NULL, 
-        tskIDLE_PRIORITY, NULL);
+        tskIDLE_PRIORITY, &lcd_ctrl_handle);
     
     xTaskCreate(
         lcd_scrolling_text, "lcd_scrl", configMINIMAL_STACK_SIZE, NULL, 
         tskIDLE_PRIORITY, NULL);
     
     xTaskCreate( 
-        lcd_adc_report, "lcd_adc", configMINIMAL_STACK_SIZE + 50, NULL, 
-        tskIDLE_PRIORITY, NULL); // This task needs a bigger stack
+        lcd_adc_report, "lcd_adc", configMINIMAL_STACK_SIZE, NULL, 
+        tskIDLE_PRIORITY, NULL);
+    
+    xTaskCreate(
+        uart_send_reports, "uart", UART_REPORT_STACK, NULL, 
+        tskIDLE_PRIORITY, NULL);
+    
+    xTaskCreate(
+        capture_send, "capture", configMINIMAL_STACK_SIZE, NULL, 
+        tskIDLE_PRIORITY + 1, NULL); // Keeps up with the capture buffer
     
     xTaskCreate(
-        uart_send_reports, "uart", configMINIMAL_STACK_SIZE + 50, NULL, 
-        tskIDLE_PRIORITY, NULL); // This too
+        log_send, "log", configMINIMAL_STACK_SIZE, NULL, 
+        tskIDLE_PRIORITY, NULL);
     
     // Start...
     vTaskStartScheduler();
@@ -3,6 +3,7 @@
 
 TaskHandle_t bl_adj_handle;
 TaskHandle_t bl_ctrl_handle;
+TaskHandle_t lcd_ctrl_handle;
 
 int main(void);
 
@@ -0,0 +1,38 @@
+/*
+ * File:   ntc.c
+ * NTC-thermistor reading to temperature conversion.
+ *
+ * ntc_table.h holds the temperature at every 2^NTC_TABLE_STEP:th ADC code,
+ * precomputed from the beta model of the thermistor by tools/ntctable. The
+ * conversion is a table lookup and a linear interpolation with one 16-bit
+ * multiplication and shifts, about 60 cycles instead of thousands for a 
+ * float log(). tools/ntctable checks the error against the float model when
+ * it generates the table and sets the valid range to the codes where the
+ * error stays within 0,2 C. The ADC saturates against its 2,5V reference
+ * at about 1,5 C, so the default range is 1,5 C to 106,9 C. 
+ * tools/ntctable/ntcbench checks this function against the model and times
+ * both. Regenerate the table if the thermistor or the divider changes.
+ */
+
+#include <stdint.h>
+#include "ntc.h"
+#include "ntc_table.h"
+
+int16_t ntc_temperature(uint16_t reading)
+{
+    uint8_t i;
+    uint8_t frac;
+    int16_t t;
+    
+    // Outside the range the ADC saturates or the table is too coarse
+    if ((reading < NTC_CODE_MIN) || (reading > NTC_CODE_MAX))
+    {
+        return NTC_OUT_OF_RANGE;
+    }
+    i = reading >> NTC_TABLE_STEP;
+    frac = reading & ((1 << NTC_TABLE_STEP) - 1);
+    t = ntc_table[i];
+    
+    // The generator keeps the difference times frac within 16 bits
+    return t + ((int16_t)((ntc_table[i + 1] - t) * frac) >> NTC_TABLE_STEP);
+}
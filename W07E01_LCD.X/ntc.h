@@ -0,0 +1,16 @@
+#ifndef NTC_H
+#define	NTC_H
+
+#include <stdint.h>
+
+/* Returned by ntc_temperature() for readings outside its range */
+#define NTC_OUT_OF_RANGE INT16_MIN
+
+/* Converts a 10-bit NTC reading to temperature in 0,1 C units, for example
+ * 235 = 23,5 C. The range is set by the divider and the ADC reference, see
+ * ntc_table.h. With the board defaults it is 1,5 C to 106,9 C, colder 
+ * readings saturate the ADC. Readings outside the range give 
+ * NTC_OUT_OF_RANGE. */
+int16_t ntc_temperature(uint16_t reading);
+
+#endif	/* NTC_H */
@@ -0,0 +1,29 @@
+/*
+ * File:   ntc_table.h
+ * Generated by tools/ntctable, do not edit.
+ *      ./ntctable -r 10000 -b 3950 -s 10000 -d 3300 -v 2500 -n 4
+ * Temperature in 0,1 C at every 16:th 10-bit ADC code.
+ * Valid from code 73 to 1022 (1,5 C to 106,9 C), error within 0,2 C.
+ */
+
+#ifndef NTC_TABLE_H
+#define NTC_TABLE_H
+
+#define NTC_TABLE_STEP 4
+#define NTC_CODE_MIN 73
+#define NTC_CODE_MAX 1022
+
+static const __flash int16_t ntc_table[65] =
+{
+     1500,  1500,  1407,  1235,  1120,  1034,   966,   909,
+      861,   819,   781,   748,   717,   689,   663,   639,
+      617,   596,   576,   557,   538,   521,   504,   489,
+      473,   458,   444,   430,   416,   403,   390,   378,
+      365,   353,   341,   330,   318,   307,   296,   285,
+      274,   263,   252,   242,   231,   221,   210,   200,
+      189,   179,   168,   158,   147,   137,   126,   116,
+      105,    94,    83,    72,    61,    49,    38,    26,
+       13,
+};
+
+#endif /* NTC_TABLE_H */
@@ -0,0 +1,67 @@
+/*
+ * File:   sensorbus.c
+ * Sensor bus, which delivers the ADC results to the tasks using them.
+ * The ADC scan in adc.c is the only producer, so every input is converted 
+ * once per its sample period no matter how many tasks use it. Subscribers
+ * are woken up with task notifications.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "sensorbus.h"
+
+struct sensorbus_subscriber
+{
+    TaskHandle_t task;
+    uint8_t inputs;         // Bit mask of subscribed inputs
+    uint8_t decimation;     // Notify on every n:th scan of those inputs
+    uint8_t count;          // Scans since the last notification
+};
+
+// Subscribers are only ever added, the ADC interrupt walks the table
+static struct sensorbus_subscriber sensorbus_subscribers[SENSORBUS_SUBSCRIBERS];
+static volatile uint8_t sensorbus_subscriber_count;
+
+int8_t sensorbus_subscribe(uint8_t inputs, uint8_t decimation)
+{
+    int8_t id = -1;
+    struct sensorbus_subscriber *subscriber;
+    
+    taskENTER_CRITICAL();
+    if (sensorbus_subscriber_count < SENSORBUS_SUBSCRIBERS)
+    {
+        id = sensorbus_subscriber_count;
+        subscriber = &sensorbus_subscribers[id];
+        subscriber->task = xTaskGetCurrentTaskHandle();
+        subscriber->inputs = inputs;
+        subscriber->decimation = decimation;
+        subscriber->count = 0;
+        // Visible to the interrupt only once it is filled in
+        sensorbus_subscriber_count++;
+    }
+    taskEXIT_CRITICAL();
+    return id;
+}
+
+void sensorbus_wait(struct adc_snapshot *snapshot)
+{
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    adc_snapshot_get(snapshot);
+}
+
+void sensorbus_publish_from_isr(uint8_t inputs, BaseType_t *woken)
+{
+    uint8_t id;
+    struct sensorbus_subscriber *subscriber;
+    
+    for (id = 0; id < sensorbus_subscriber_count; id++)
+    {
+        subscriber = &sensorbus_subscribers[id];
+        if ((subscriber->inputs & inputs) && 
+            (++subscriber->count >= subscriber->decimation))
+        {
+            subscriber->count = 0;
+            vTaskNotifyGiveFromISR(subscriber->task, woken);
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef SENSORBUS_H
+#define	SENSORBUS_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "adc.h"
+
+// Maximum number of subscribers
+#define SENSORBUS_SUBSCRIBERS 4
+
+// Bit mask of an input (LDR, NTC, POT) for sensorbus_subscribe()
+#define SENSORBUS_INPUT(input) (1 << (input))
+
+/* Subscribes the calling task to the inputs in the bit mask. The task is 
+ * notified after every decimation:th scan that converted any of these 
+ * inputs. The sample rate of each input is set with adc_rate_set(), and it
+ * slows down while the input is steady. 
+ * Returns the subscriber number, or -1 if there is no room left. */
+int8_t sensorbus_subscribe(uint8_t inputs, uint8_t decimation);
+
+/* Waits for the next notification of the calling task and copies the 
+ * latest results. */
+void sensorbus_wait(struct adc_snapshot *snapshot);
+
+/* Called by the ADC interrupt after a scan that converted the inputs in the
+ * bit mask. Sets woken if a notified task should run next. */
+void sensorbus_publish_from_isr(uint8_t inputs, BaseType_t *woken);
+
+#endif	/* SENSORBUS_H */
@@ -0,0 +1,76 @@
+/*
+ * File:   telemetry.c
+ * Binary frames, see telemetry.h for the format.
+ *
+ * Only plain C, so that the host decoders in tools/ use the same CRC as the
+ * firmware.
+ */
+
+#include "telemetry.h"
+
+uint16_t telemetry_crc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+    while (len--)
+    {
+        crc ^= (uint16_t)*data++ << 8;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+size_t telemetry_encode(uint8_t *frame, uint8_t type, const uint8_t *payload,
+    size_t len)
+{
+    uint16_t crc = telemetry_crc16(telemetry_crc16(0xFFFF, &type, 1), 
+        payload, len);
+    uint8_t trailer[2] = {crc & 0xFF, crc >> 8};
+    uint8_t *code;
+    uint8_t *dst;
+    uint8_t byte;
+    
+    // COBS: each zero byte is replaced by the distance to the next zero 
+    // byte, and a leading code byte holds the distance to the first one. 
+    // The encoded part is shorter than 254 bytes, so no extra code bytes 
+    // are needed. The bytes come from type, payload and trailer in turn,
+    // so nothing is copied into a temporary record.
+    frame[0] = 0; // Ends anything before this frame
+    code = &frame[1];
+    dst = &frame[2];
+    for (size_t i = 0; i < len + 3; i++)
+    {
+        byte = (i == 0) ? type : 
+            (i <= len) ? payload[i - 1] : trailer[i - len - 1];
+        if (byte == 0)
+        {
+            *code = dst - code;
+            code = dst++;
+        }
+        else
+        {
+            *dst++ = byte;
+        }
+    }
+    *code = dst - code;
+    *dst++ = 0; // Delimiter
+    return dst - frame;
+}
+
+size_t telemetry_frame(uint8_t *frame, uint8_t seq, uint16_t time_ms, 
+    const uint16_t *values)
+{
+    uint8_t report[TELEMETRY_REPORT_BYTES];
+    uint8_t *p = report;
+    
+    *p++ = seq;
+    *p++ = time_ms & 0xFF;
+    *p++ = time_ms >> 8;
+    for (uint8_t i = 0; i < TELEMETRY_VALUES; i++)
+    {
+        *p++ = values[i] & 0xFF;
+        *p++ = values[i] >> 8;
+    }
+    return telemetry_encode(frame, TELEMETRY_REPORT, report, sizeof(report));
+}
@@ -0,0 +1,58 @@
+#ifndef TELEMETRY_H
+#define	TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Frame format
+ *
+ *      All binary output on the UART is sent in frames:
+ *          zero byte
+ *          COBS encoded: type, payload, CRC-16/CCITT-FALSE of the type and
+ *          the payload (2 bytes, little-endian)
+ *          zero byte
+ *      COBS removes every zero byte from the encoded part, so a receiver
+ *      finds the frames by the zeros alone and can start anywhere in the
+ *      stream. The leading zero ends whatever came before, so text 
+ *      reports and frames can share the UART. tools/telemetry reads the
+ *      frames, tools/logexpand the log frames.
+ *
+ * TELEMETRY_REPORT - Payload, little-endian:
+ *          sequence number, 1 byte, one more than in the previous report
+ *          timestamp in ms, 2 bytes (RTOS tick count)
+ *          TELEMETRY_VALUES readings (LDR, NTC, POT), 2 bytes each
+ *      A gap in the sequence numbers tells how many reports were lost.
+ * TELEMETRY_CAPTURE - Payload is a capture block, see capture.h
+ * TELEMETRY_LOG - Payload is one or more log records, see log.h
+ */
+#define TELEMETRY_REPORT        0x01
+#define TELEMETRY_CAPTURE       0x02
+#define TELEMETRY_LOG           0x03
+
+// Payloads up to 250 bytes keep the COBS part within 254 bytes, which needs
+// a single code byte
+#define TELEMETRY_PAYLOAD_MAX   250
+// Zero, COBS code, type, CRC, zero
+#define TELEMETRY_OVERHEAD      6
+
+#define TELEMETRY_VALUES        3
+#define TELEMETRY_REPORT_BYTES  (3 + 2 * TELEMETRY_VALUES)
+#define TELEMETRY_FRAME_BYTES   (TELEMETRY_REPORT_BYTES + TELEMETRY_OVERHEAD)
+
+/* Returns the CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF)
+ * of len bytes of data, continuing from crc. Start with 0xFFFF. */
+uint16_t telemetry_crc16(uint16_t crc, const uint8_t *data, size_t len);
+
+/* Writes a frame of the given type and payload (at most 
+ * TELEMETRY_PAYLOAD_MAX bytes) to frame, which needs room for 
+ * len + TELEMETRY_OVERHEAD bytes. Returns the frame length. */
+size_t telemetry_encode(uint8_t *frame, uint8_t type, const uint8_t *payload,
+    size_t len);
+
+/* Writes a complete TELEMETRY_REPORT frame of the given values to frame,
+ * which needs room for TELEMETRY_FRAME_BYTES. Returns the frame length. */
+size_t telemetry_frame(uint8_t *frame, uint8_t seq, uint16_t time_ms, 
+    const uint16_t *values);
+
+#endif	/* TELEMETRY_H */
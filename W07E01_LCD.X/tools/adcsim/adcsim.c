@@ -0,0 +1,638 @@
+/*
+ * File:   adcsim.c
+ * Host side simulation of the ADC scan in adc.c, measures sample timing
+ * jitter.
+ *
+ * adc.c is compiled for Linux and driven by a simulated RTC PIT, event
+ * system and ADC0, in CPU cycles:
+ *      - the PIT sets its flag every 512 RTC cycles (15,6 ms), whether its
+ *        interrupt is enabled or not, and raises the event
+ *      - the event starts a conversion if ADC0.EVCTRL has STARTEI
+ *      - conversions start on the next CLK_ADC edge and take the time given
+ *        by the prescaler, delays, sample length and accumulation
+ *      - interrupts are served as soon as the CPU has interrupts enabled.
+ *        A background load keeps them disabled now and then: the tick
+ *        interrupt, the LCD and UART interrupts and critical sections.
+ *
+ * The start of each scan is measured against the PIT event that was due to
+ * start it, in three modes:
+ *      event   The PIT event starts the scan through STARTEI (adc.c now)
+ *      isr     The PIT interrupt starts the scan, as before the event
+ *              system was used. The start waits for the interrupt latency.
+ *      task    An idle priority task started by vTaskDelay() starts the
+ *              scan, as in the original code. The start waits for the next
+ *              tick, for the other idle priority tasks and for the
+ *              interrupt latency.
+ * Only the scan start is timed differently in the modes, everything after
+ * it runs the code of adc.c. The second and third input of a scan are
+ * started by the RESRDY interrupt in every mode.
+ *
+ * The simulation also checks that
+ *      - every PIT period is counted exactly once, by a scan started by
+ *        the event or by the PIT interrupt
+ *      - the sensor bus is told exactly the inputs converted in the scan
+ *      - with fixed rates, every input is converted once per its divider
+ *      - with the potentiometer watched by the window comparator (adc_watch),
+ *        every step of the test signal notifies within two scan periods and
+ *        a conversion (the conversion during the step may not yet leave the
+ *        window), and no notification comes from a result within the window
+ *        of the previous one
+ *
+ * Usage:   make && ./adcsim [-t seconds] [-b busy] [-s seed]
+ *      -t  Simulated time in seconds (60)
+ *      -b  Share of time the other idle priority tasks are running,
+ *          task mode only (0.5)
+ *      -s  Seed of the background load (1)
+ * Exits with 1 if any check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "FreeRTOS.h"
+#include "../../adc.c"
+
+/******************************************************************************
+ * Simulated MCU
+ *****************************************************************************/
+ADC_t ADC0;
+RTC_t RTC;
+EVSYS_t EVSYS;
+VREF_t VREF;
+PORT_t PORTE, PORTF;
+
+#define CPU_HZ                  configCPU_CLOCK_HZ
+#define RTC_HZ                  32768
+#define PIT_CYCLES              512
+#define TICK_CYCLES             (CPU_HZ / configTICK_RATE_HZ)
+#define ISR_ENTRY_CYCLES        25  // Response, vector jump and prologue
+#define ISR_CYCLES              200 // Body and epilogue of an adc.c ISR
+#define NEVER                   UINT64_MAX
+#define POT_STEP_SECONDS        7   // Period of the steps of the POT signal
+#define WATCH_WINDOW            41  // Same as POT_INTERACTION in backlight.c
+
+enum mode
+{
+    MODE_EVENT,
+    MODE_ISR,
+    MODE_TASK,
+    MODE_CHECK,             // Event mode with fixed rates
+    MODE_WATCH,             // Event mode with POT watched
+};
+
+static const char *mode_names[] =
+{
+    "event  (STARTEI, adc.c)",
+    "isr    (PIT interrupt)",
+    "task   (vTaskDelay)",
+};
+
+static enum mode mode;
+static double seconds = 60;
+static double busy = 0.5;
+static uint32_t seed = 1;
+
+// Pending interrupt flags, kept here since the registers are write-one-to-
+// clear and adc.c writes them as plain memory
+static uint8_t pit_flag;
+static uint8_t adc_flags;
+
+// Conversion in progress
+static uint64_t conv_done = NEVER;
+static uint8_t conv_input;
+static uint16_t conv_result;
+static uint64_t scan_start;
+static uint8_t scan_position;   // Conversions started in this scan
+static uint8_t scan_converted;  // Inputs converted since the last publish
+
+static uint32_t random_state;
+
+// Statistics
+static unsigned long events;
+static unsigned long periods_counted;
+static unsigned long overruns;
+static unsigned long publish_errors;
+static unsigned long conversions[ADC_CHANNELS];
+static unsigned long wakeups[ADC_CHANNELS];
+static unsigned long watch_notifications;
+static unsigned long watch_repeats;     // Result within the previous window
+static unsigned long watch_steps;       // Steps of the signal notified about
+static long watch_step = -1;            // Step of the previous notification
+static uint16_t watch_value;            // Result of the previous notification
+static uint64_t watch_latency;          // Longest step to notification
+static uint64_t sim_time;
+
+struct jitter
+{
+    unsigned long count;
+    double min, max, sum, sum2;
+};
+
+static struct jitter scan_jitter;   // Scan start after its PIT event
+static struct jitter chain_jitter;  // Later inputs after the scan start
+
+static uint32_t sim_random(void)
+{
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 8;
+}
+
+// Uniform in [0, 1)
+static double sim_uniform(void)
+{
+    return (sim_random() & 0xFFFFFF) / (double)0x1000000;
+}
+
+static void jitter_add(struct jitter *j, double cycles)
+{
+    double us = cycles * 1e6 / CPU_HZ;
+
+    if (j->count == 0 || us < j->min)
+    {
+        j->min = us;
+    }
+    if (j->count == 0 || us > j->max)
+    {
+        j->max = us;
+    }
+    j->sum += us;
+    j->sum2 += us * us;
+    j->count++;
+}
+
+static uint64_t pit_event_time(unsigned long n)
+{
+    return (uint64_t)n * PIT_CYCLES * CPU_HZ / RTC_HZ;
+}
+
+/******************************************************************************
+ * Background load, times when interrupts are disabled
+ *****************************************************************************/
+static struct load
+{
+    const char *name;
+    double per_second;      // 0 = periodic at TICK_CYCLES
+    uint32_t cycles;
+    uint64_t start;         // Current or next window
+} loads[] =
+{
+    {"tick interrupt and context switch", 0, 180, 0},
+    {"LCD transmit interrupt", 170, 70, 0},
+    {"UART transmit interrupt", 200, 45, 0},
+    {"critical sections of tasks", 2000, 60, 0},
+};
+
+#define LOADS                   (sizeof(loads) / sizeof(loads[0]))
+
+static void load_next(struct load *l)
+{
+    if (l->per_second == 0)
+    {
+        l->start += TICK_CYCLES;
+    }
+    else
+    {
+        // Poisson arrivals
+        l->start += (uint64_t)(-log(1.0 - sim_uniform()) * CPU_HZ /
+            l->per_second) + l->cycles;
+    }
+}
+
+// First time from t on when interrupts are enabled. Times asked must not
+// go backwards.
+static uint64_t interruptible(uint64_t t)
+{
+    int moved;
+
+    do
+    {
+        moved = 0;
+        for (unsigned i = 0; i < LOADS; i++)
+        {
+            while (loads[i].start + loads[i].cycles <= t)
+            {
+                load_next(&loads[i]);
+            }
+            if (loads[i].start <= t)
+            {
+                t = loads[i].start + loads[i].cycles;
+                moved = 1;
+            }
+        }
+    } while (moved);
+    return t;
+}
+
+/******************************************************************************
+ * Stubs of the rest of the firmware
+ *****************************************************************************/
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    watch_notifications++;
+}
+
+void capture_sample_from_isr(uint16_t sample, BaseType_t *woken)
+{
+}
+
+void sensorbus_publish_from_isr(uint8_t inputs, BaseType_t *woken)
+{
+    if (inputs != scan_converted)
+    {
+        if (publish_errors++ < 10)
+        {
+            printf("  published inputs 0x%X, converted 0x%X\n", inputs,
+                scan_converted);
+        }
+    }
+    for (uint8_t input = 0; input < ADC_CHANNELS; input++)
+    {
+        if (inputs & (1 << input))
+        {
+            wakeups[input]++;
+        }
+    }
+    scan_converted = 0;
+}
+
+/******************************************************************************
+ * ADC0, RTC PIT and the interrupt controller
+ *****************************************************************************/
+// Test signals as 10-bit samples: steady with noise, and steps now and then
+static uint16_t input_signal(uint8_t input, uint64_t t)
+{
+    double s = (double)t / CPU_HZ;
+    int noise = (int)(sim_random() % 9) - 4;
+
+    switch (input)
+    {
+        case LDR:
+            return 600 + ((long)(s / 5) % 2) * 150 + noise / 2;
+        case NTC:
+            return 480 + (long)(s / 20) + noise / 4;
+        default:
+            return 700 + ((long)(s / POT_STEP_SECONDS) % 2) * 200 + noise;
+    }
+}
+
+static uint8_t mux_input(uint8_t muxpos)
+{
+    for (uint8_t input = 0; input < ADC_CHANNELS; input++)
+    {
+        if (adc_channels[input].muxpos == muxpos)
+        {
+            return input;
+        }
+    }
+    return 0;
+}
+
+// Start a conversion with the current settings, returns its start
+static uint64_t adc_start(uint64_t t)
+{
+    uint32_t presc = 2 << (ADC0.CTRLC & ADC_PRESC_gm);
+    uint8_t initdly = (ADC0.CTRLD & ADC_INITDLY_gm) >> ADC_INITDLY_gp;
+    uint32_t delay = initdly ? 16 << (initdly - 1) : 0;
+    uint32_t samples = 1 << (ADC0.CTRLB & ADC_SAMPNUM_gm);
+    uint32_t sample_adc = (ADC0.CTRLD & ADC_SAMPDLY_gm) + 2 +
+        ADC0.SAMPCTRL + 13;
+
+    // Starts on the next CLK_ADC edge
+    t = (t + presc - 1) / presc * presc;
+    conv_input = mux_input(ADC0.MUXPOS);
+    conv_result = 0;
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        conv_result += input_signal(conv_input, t + i * sample_adc * presc);
+    }
+    conv_done = t + presc * (delay + samples * sample_adc);
+
+    if (scan_position++ == 0)
+    {
+        scan_start = t;
+    }
+    else
+    {
+        jitter_add(&chain_jitter, t - scan_start);
+    }
+    return t;
+}
+
+static void adc_complete(void)
+{
+    ADC0.RES = conv_result;
+    adc_flags |= ADC_RESRDY_bm;
+    if ((ADC0.CTRLE == ADC_WINCM_OUTSIDE_gc) &&
+        ((conv_result < ADC0.WINLT) || (conv_result > ADC0.WINHT)))
+    {
+        adc_flags |= ADC_WCMP_bm;
+    }
+    conversions[conv_input]++;
+    scan_converted |= 1 << conv_input;
+    conv_done = NEVER;
+}
+
+// Runs firmware code and applies its writes to the interrupt flags
+static void firmware_call(void (*function)(void))
+{
+    RTC.PITINTFLAGS = 0;
+    ADC0.INTFLAGS = 0;
+    function();
+    pit_flag &= ~RTC.PITINTFLAGS;
+    adc_flags &= ~ADC0.INTFLAGS;
+}
+
+// Checks each notification of the watched input against the previous one
+static void watch_isr(void)
+{
+    uint16_t value = adc_scan_results[adc_watch_input];
+    long step = (long)(sim_time / CPU_HZ / POT_STEP_SECONDS);
+    
+    // The comparator sees the sum, a result just above the window can
+    // decimate to center + window, but never to less
+    if (watch_notifications && (abs(value - watch_value) < WATCH_WINDOW))
+    {
+        if (watch_repeats++ < 10)
+        {
+            printf("  notified again at %u, %u before\n", value, 
+                watch_value);
+        }
+    }
+    if (step != watch_step)
+    {
+        uint64_t latency = sim_time - (uint64_t)step * POT_STEP_SECONDS * 
+            CPU_HZ;
+        
+        if (latency > watch_latency)
+        {
+            watch_latency = latency;
+        }
+        watch_step = step;
+        watch_steps++;
+    }
+    watch_value = value;
+    ADC0_WCOMP_vect();
+}
+
+static void pit_isr(void)
+{
+    // Only counts a period while the scan is not armed
+    if (!adc_capturing)
+    {
+        periods_counted++;
+    }
+    RTC_PIT_vect();
+}
+
+// Serve pending interrupts from t on, highest priority (lowest vector)
+// first. Returns the time after the last one.
+static uint64_t interrupts_serve(uint64_t t)
+{
+    while (1)
+    {
+        uint8_t pit = pit_flag && (RTC.PITINTCTRL & RTC_PI_bm);
+        uint8_t resrdy = (adc_flags & ADC0.INTCTRL) & ADC_RESRDY_bm;
+        uint8_t wcmp = (adc_flags & ADC0.INTCTRL) & ADC_WCMP_bm;
+
+        if (!pit && !resrdy && !wcmp)
+        {
+            return t;
+        }
+        t = interruptible(t) + ISR_ENTRY_CYCLES;
+        sim_time = t;
+        if (pit)
+        {
+            firmware_call(pit_isr);
+        }
+        else if (resrdy)
+        {
+            adc_flags &= ~ADC_RESRDY_bm; // Reading RES clears it
+            firmware_call(ADC0_RESRDY_vect);
+        }
+        else
+        {
+            firmware_call(watch_isr);
+        }
+        t += ISR_CYCLES;
+        if (ADC0.COMMAND & ADC_STCONV_bm)
+        {
+            ADC0.COMMAND = 0;
+            adc_start(t);
+        }
+    }
+}
+
+// When the scan due at the PIT event at t starts in the current mode
+static uint64_t scan_start_time(uint64_t t)
+{
+    switch (mode)
+    {
+        case MODE_ISR:
+            return interruptible(t) + ISR_ENTRY_CYCLES + ISR_CYCLES / 2;
+        case MODE_TASK:
+            // Woken up by the next tick, then waits for the time slice of
+            // another idle priority task if one is running
+            t = (t + TICK_CYCLES - 1) / TICK_CYCLES * TICK_CYCLES;
+            if (sim_uniform() < busy)
+            {
+                t += (uint64_t)(sim_uniform() * TICK_CYCLES);
+            }
+            return interruptible(t) + ISR_CYCLES;
+        default:
+            return t;
+    }
+}
+
+/******************************************************************************
+ * Runs and report
+ *****************************************************************************/
+static void jitter_print(const char *name, struct jitter *j)
+{
+    double mean = j->sum / j->count;
+    double rms = sqrt(j->sum2 / j->count - mean * mean);
+
+    printf("  %-28s %6lu  min %9.1f us  max %9.1f us  p-p %9.1f us  "
+        "rms %8.2f us\n", name, j->count, j->min, j->max, j->max - j->min,
+        rms);
+}
+
+static int run(void)
+{
+    unsigned long n;
+    uint64_t t = 0;
+    uint64_t t_event;
+    int failed = 0;
+
+    random_state = seed;
+    firmware_call(adc_init);
+    if (mode == MODE_CHECK)
+    {
+        adc_rate_set(LDR, 4, 4, 0);
+        adc_rate_set(NTC, 16, 16, 0);
+        adc_rate_set(POT, 1, 1, 0);
+    }
+    if (mode == MODE_WATCH)
+    {
+        adc_watch(POT, WATCH_WINDOW, (TaskHandle_t)1);
+    }
+
+    for (n = 1; (t_event = pit_event_time(n)) < seconds * CPU_HZ; n++)
+    {
+        // Finish the scan in progress
+        while (conv_done <= t_event)
+        {
+            t = (conv_done > t) ? conv_done : t;
+            adc_complete();
+            t = interrupts_serve(t);
+        }
+
+        // PIT period elapsed. The flag is set even with the interrupt off.
+        events++;
+        pit_flag = 1;
+        if (ADC0.EVCTRL & ADC_STARTEI_bm)
+        {
+            if (conv_done != NEVER)
+            {
+                overruns++;
+            }
+            else
+            {
+                periods_counted++;
+                scan_position = 0;
+                jitter_add(&scan_jitter,
+                    adc_start(scan_start_time(t_event)) - t_event);
+            }
+        }
+        t = interrupts_serve((t > t_event) ? t : t_event);
+    }
+
+    if (mode == MODE_CHECK)
+    {
+        static const uint8_t dividers[ADC_CHANNELS] = {4, 16, 1};
+
+        printf("fixed rate check, %lu PIT periods\n", events);
+        for (uint8_t input = 0; input < ADC_CHANNELS; input++)
+        {
+            unsigned long expected = events / dividers[input];
+            int ok = (conversions[input] + 1 >= expected) &&
+                (conversions[input] <= expected + 1);
+
+            printf("  input %u  divider %3u  %6lu conversions, expected "
+                "%lu%s\n", input, dividers[input], conversions[input],
+                expected, ok ? "" : "  FAIL");
+            failed |= !ok;
+        }
+    }
+    else if (mode == MODE_WATCH)
+    {
+        // Every step, and the start with the window at 0
+        unsigned long expected = (unsigned long)((seconds - 0.5) / 
+            POT_STEP_SECONDS) + 1;
+        
+        printf("window comparator watch of POT, window %u\n", WATCH_WINDOW);
+        printf("  %lu notifications, %lu of %lu steps notified, %lu "
+            "repeated\n", watch_notifications, watch_steps, expected, 
+            watch_repeats);
+        printf("  slowest step notified after %.1f ms\n", 
+            watch_latency * 1e3 / CPU_HZ);
+        if (watch_steps != expected)
+        {
+            printf("  FAIL: steps missed\n");
+            failed = 1;
+        }
+        // The longest conversion, 64 samples, takes 4,6 ms
+        if (watch_latency > pit_event_time(2) + CPU_HZ / 200)
+        {
+            printf("  FAIL: a step was noticed after more than two scan "
+                "periods\n");
+            failed = 1;
+        }
+        if (watch_repeats)
+        {
+            printf("  FAIL: %lu notifications for a change already "
+                "notified\n", watch_repeats);
+            failed = 1;
+        }
+    }
+    else
+    {
+        printf("%s\n", mode_names[mode]);
+        jitter_print("scan start after PIT event", &scan_jitter);
+        jitter_print("later inputs after start", &chain_jitter);
+        printf("  conversions LDR %lu, NTC %lu, POT %lu, sensor bus "
+            "wake-ups LDR %lu, NTC %lu, POT %lu\n",
+            conversions[LDR], conversions[NTC], conversions[POT],
+            wakeups[LDR], wakeups[NTC], wakeups[POT]);
+    }
+    if (periods_counted != events)
+    {
+        printf("  FAIL: %lu PIT periods counted as %lu\n", events,
+            periods_counted);
+        failed = 1;
+    }
+    if (overruns)
+    {
+        printf("  FAIL: %lu scans still running at the next PIT event\n",
+            overruns);
+        failed = 1;
+    }
+    if (publish_errors)
+    {
+        printf("  FAIL: %lu scans published to the sensor bus with the "
+            "wrong inputs\n", publish_errors);
+        failed = 1;
+    }
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    int failed = 0;
+
+    while ((opt = getopt(argc, argv, "t:b:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 'b':
+                busy = atof(optarg);
+                break;
+            case 's':
+                seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t seconds] [-b busy] "
+                    "[-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    printf("ADC scan timing, %.0f s, CPU %lu Hz, PIT period %.1f us\n",
+        seconds, (unsigned long)CPU_HZ, PIT_CYCLES * 1e6 / RTC_HZ);
+    fflush(stdout);
+
+    // adc.c keeps its state in statics, so every mode runs in a fresh
+    // process
+    for (mode = MODE_EVENT; mode <= MODE_WATCH; mode++)
+    {
+        int status;
+
+        if (fork() == 0)
+        {
+            int result = run();
+            fflush(stdout);
+            _exit(result);
+        }
+        wait(&status);
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+    }
+    printf("%s\n", failed ? "FAILED" : "all checks passed");
+    return failed;
+}
@@ -0,0 +1,29 @@
+/*
+ * Just enough of the FreeRTOS API for the host build of adc.c. The scan
+ * simulator runs adc.c single-threaded and calls its interrupts itself, so
+ * critical sections are no-ops.
+ */
+
+#ifndef ADCSIM_FREERTOS_H
+#define ADCSIM_FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define configCPU_CLOCK_HZ      3333333
+#define configTICK_RATE_HZ      1000
+
+typedef uint16_t TickType_t;
+typedef int8_t BaseType_t;
+typedef void *TaskHandle_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define portYIELD_FROM_ISR()
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+
+#endif /* ADCSIM_FREERTOS_H */
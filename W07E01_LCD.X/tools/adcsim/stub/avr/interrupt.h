@@ -0,0 +1,11 @@
+/* Interrupts of adc.c become plain functions called by the simulator */
+
+#ifndef ADCSIM_AVR_INTERRUPT_H
+#define ADCSIM_AVR_INTERRUPT_H
+
+#define ISR(vector)             void vector(void)
+#define RTC_PIT_vect            adcsim_rtc_pit_isr
+#define ADC0_RESRDY_vect        adcsim_adc0_resrdy_isr
+#define ADC0_WCOMP_vect         adcsim_adc0_wcomp_isr
+
+#endif /* ADCSIM_AVR_INTERRUPT_H */
@@ -0,0 +1,109 @@
+/*
+ * Minimal <avr/io.h> for the host build of adc.c. Only the registers and
+ * bit masks that adc.c touches are defined, with the ATmega4809 values, so
+ * that the simulator can decode the settings.
+ */
+
+#ifndef ADCSIM_AVR_IO_H
+#define ADCSIM_AVR_IO_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    volatile uint8_t CTRLA;
+    volatile uint8_t CTRLB;
+    volatile uint8_t CTRLC;
+    volatile uint8_t CTRLD;
+    volatile uint8_t CTRLE;
+    volatile uint8_t SAMPCTRL;
+    volatile uint8_t MUXPOS;
+    volatile uint8_t COMMAND;
+    volatile uint8_t EVCTRL;
+    volatile uint8_t INTCTRL;
+    volatile uint8_t INTFLAGS;
+    volatile uint16_t RES;
+    volatile uint16_t WINLT;
+    volatile uint16_t WINHT;
+} ADC_t;
+
+typedef struct
+{
+    volatile uint8_t CLKSEL;
+    volatile uint8_t PITCTRLA;
+    volatile uint8_t PITSTATUS;
+    volatile uint8_t PITINTCTRL;
+    volatile uint8_t PITINTFLAGS;
+} RTC_t;
+
+typedef struct
+{
+    volatile uint8_t CHANNEL1;
+    volatile uint8_t USERADC0;
+} EVSYS_t;
+
+typedef struct
+{
+    volatile uint8_t CTRLA;
+} VREF_t;
+
+typedef struct
+{
+    volatile uint8_t DIRCLR;
+    volatile uint8_t PIN0CTRL;
+    volatile uint8_t PIN1CTRL;
+    volatile uint8_t PIN4CTRL;
+} PORT_t;
+
+extern ADC_t ADC0;
+extern RTC_t RTC;
+extern EVSYS_t EVSYS;
+extern VREF_t VREF;
+extern PORT_t PORTE, PORTF;
+
+#define PIN0_bm                 0x01
+#define PIN1_bm                 0x02
+#define PIN4_bm                 0x10
+#define PORT_ISC_INPUT_DISABLE_gc 0x04
+
+#define ADC_ENABLE_bm           0x01
+#define ADC_SAMPNUM_gm          0x07
+#define ADC_SAMPNUM_ACC1_gc     0x00
+#define ADC_SAMPNUM_ACC4_gc     0x02
+#define ADC_SAMPNUM_ACC16_gc    0x04
+#define ADC_SAMPNUM_ACC64_gc    0x06
+#define ADC_PRESC_gm            0x07
+#define ADC_PRESC_DIV16_gc      0x03
+#define ADC_REFSEL_INTREF_gc    0x00
+#define ADC_REFSEL_VDDREF_gc    0x10
+#define ADC_SAMPCAP_bm          0x40
+#define ADC_INITDLY_gm          0xE0
+#define ADC_INITDLY_gp          5
+#define ADC_INITDLY_DLY16_gc    0x20
+#define ADC_ASDV_bm             0x10
+#define ADC_SAMPDLY_gm          0x0F
+#define ADC_SAMPDLY_gp          0
+#define ADC_SAMPDLY0_bm         0x01
+#define ADC_WINCM_NONE_gc       0x00
+#define ADC_WINCM_OUTSIDE_gc    0x04
+#define ADC_MUXPOS_AIN8_gc      0x08
+#define ADC_MUXPOS_AIN9_gc      0x09
+#define ADC_MUXPOS_AIN14_gc     0x0E
+#define ADC_STCONV_bm           0x01
+#define ADC_STARTEI_bm          0x01
+#define ADC_RESRDY_bm           0x01
+#define ADC_WCMP_bm             0x02
+
+#define RTC_CLKSEL_INT32K_gc    0x00
+#define RTC_PERIOD_CYC512_gc    0x40
+#define RTC_PITEN_bm            0x01
+#define RTC_CTRLBUSY_bm         0x01
+#define RTC_PI_bm               0x01
+
+#define EVSYS_GENERATOR_RTC_PIT0_gc 0x08
+#define EVSYS_CHANNEL_CHANNEL1_gc   0x02
+#define EVSYS_CHANNEL_CHANNEL2_gc   0x03
+
+#define VREF_ADC0REFSEL_2V5_gc  0x20
+
+#endif /* ADCSIM_AVR_IO_H */
@@ -0,0 +1 @@
+/* Everything adc.c needs is in the FreeRTOS.h stub */
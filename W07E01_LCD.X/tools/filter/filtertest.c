@@ -0,0 +1,271 @@
+/*
+ * File:   filtertest.c
+ * Step response tests and a benchmark of filter.c on the host.
+ *
+ * Every filter type and parameter is fed a step from the lowest to the
+ * highest 13-bit value and back. The step response is checked:
+ *      - the first sample is the output, the history starts from it
+ *      - the output stays between the old and the new level, no overshoot
+ *        and no wrap-around of the fixed-point state
+ *      - the output reaches the new level within the expected number of
+ *        samples: at once without a filter, after the window for
+ *        FILTER_AVERAGE, after half the window for the medians and within
+ *        12 time constants for FILTER_IIR
+ *      - the medians ignore spikes shorter than half their window
+ *      - FILTER_IIR stays within one code of a float model of the filter on
+ *        a noisy input
+ * Then every filter is timed over many samples. The times are host times and
+ * only compare the filters with each other, cycles on the ATmega4809 have
+ * to be measured on the target.
+ *
+ * Usage:   make && ./filtertest [-n samples]
+ *      -n  Samples per filter in the benchmark (10000000)
+ * Exits with 1 if any test fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "filter.h"
+
+#define LOW                     0
+#define HIGH                    8191    // Largest supported input, 13 bits
+#define STEP_SAMPLES            4096
+
+static const struct
+{
+    uint8_t type;
+    uint8_t param_min;
+    uint8_t param_max;
+    const char *name;
+} filters[] =
+{
+    {FILTER_NONE, 0, 0, "none"},
+    {FILTER_IIR, 1, 7, "iir"},
+    {FILTER_AVERAGE, 1, 3, "average"},
+    {FILTER_MEDIAN3, 0, 0, "median3"},
+    {FILTER_MEDIAN5, 0, 0, "median5"},
+};
+
+#define FILTERS                 (sizeof(filters) / sizeof(filters[0]))
+
+static int failures;
+
+static void fail(const char *name, uint8_t param, const char *what, int n)
+{
+    printf("  FAIL %s %u: %s at sample %d\n", name, param, what, n);
+    failures++;
+}
+
+// Samples the output needs to settle on a step
+static int settle_limit(uint8_t type, uint8_t param)
+{
+    switch (type)
+    {
+        case FILTER_IIR:
+            return 12 << param;
+        case FILTER_AVERAGE:
+            return 1 << param;
+        case FILTER_MEDIAN3:
+            return 2;
+        case FILTER_MEDIAN5:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+// One step from -> to. Returns the samples to 63 % of the step, or -1.
+static int step(struct filter *f, const char *name, uint8_t param,
+    uint16_t from, uint16_t to)
+{
+    uint16_t low = (from < to) ? from : to;
+    uint16_t high = (from < to) ? to : from;
+    uint16_t tau_level = from + (to - from) * 63 / 100;
+    int tau = -1;
+    int settled = -1;
+    int n;
+
+    for (n = 1; n <= STEP_SAMPLES; n++)
+    {
+        uint16_t y = filter_apply(f, to);
+
+        if ((y < low) || (y > high))
+        {
+            fail(name, param, "output outside the step", n);
+            return -1;
+        }
+        if ((tau < 0) && ((from < to) ? (y >= tau_level) : (y <= tau_level)))
+        {
+            tau = n;
+        }
+        if ((settled < 0) && (y == to))
+        {
+            settled = n;
+        }
+        if ((settled >= 0) && (y != to))
+        {
+            fail(name, param, "output left the new level", n);
+            return -1;
+        }
+    }
+    if ((settled < 0) || (settled > settle_limit(f->type, param)))
+    {
+        fail(name, param, "output settled too late", settled);
+    }
+    return tau;
+}
+
+static void test_steps(void)
+{
+    struct filter f;
+
+    printf("step response %u -> %u -> %u, samples to 63 %%\n", LOW, HIGH,
+        LOW);
+    for (unsigned i = 0; i < FILTERS; i++)
+    {
+        for (uint8_t param = filters[i].param_min;
+            param <= filters[i].param_max; param++)
+        {
+            int up;
+            int down;
+
+            filter_init(&f, filters[i].type, param);
+            if (filter_apply(&f, LOW) != LOW)
+            {
+                fail(filters[i].name, param, "first sample not passed", 1);
+            }
+            up = step(&f, filters[i].name, param, LOW, HIGH);
+            down = step(&f, filters[i].name, param, HIGH, LOW);
+            printf("  %-8s %u  up %4d  down %4d\n", filters[i].name, param,
+                up, down);
+        }
+    }
+}
+
+static void test_spikes(void)
+{
+    struct filter f;
+    uint8_t type;
+    int width;
+    int n;
+
+    for (type = FILTER_MEDIAN3; type <= FILTER_MEDIAN5; type++)
+    {
+        // Median of 3 ignores one sample, median of 5 two samples
+        int longest = (type == FILTER_MEDIAN3) ? 1 : 2;
+
+        for (width = 1; width <= longest; width++)
+        {
+            filter_init(&f, type, 0);
+            for (n = 0; n < 20; n++)
+            {
+                uint16_t x = ((n >= 10) && (n < 10 + width)) ? HIGH : 1000;
+
+                if (filter_apply(&f, x) != 1000)
+                {
+                    fail(filters[type].name, 0, "spike passed", n);
+                    break;
+                }
+            }
+        }
+    }
+    printf("median spike rejection checked\n");
+}
+
+static void test_iir_model(void)
+{
+    struct filter f;
+    uint8_t param;
+    int n;
+
+    for (param = 1; param <= 7; param++)
+    {
+        double model = 0;
+        double worst = 0;
+
+        filter_init(&f, FILTER_IIR, param);
+        srand(param);
+        for (n = 0; n < 100000; n++)
+        {
+            // Slow triangle wave with noise, over the full 13-bit range
+            int x = (n / 10) % 1600;
+            x = ((x < 800) ? x : 1600 - x) * 10 + rand() % 64 - 32;
+            x = (x < 0) ? 0 : (x > HIGH) ? HIGH : x;
+
+            // Primed with the first sample like the filter
+            model = (n == 0) ? x : model + (x - model) / (1 << param);
+            double error = fabs(filter_apply(&f, x) - model);
+            if (error > worst)
+            {
+                worst = error;
+            }
+        }
+        if (worst > 1.0)
+        {
+            fail("iir", param, "more than 1 from the float model", n);
+        }
+        printf("  iir      %u  largest error to float model %.2f\n", param,
+            worst);
+    }
+}
+
+static void benchmark(long samples)
+{
+    struct filter f;
+    struct timespec start;
+    struct timespec end;
+    volatile uint16_t sink;
+
+    printf("benchmark, %ld samples per filter, host ns per sample\n",
+        samples);
+    for (unsigned i = 0; i < FILTERS; i++)
+    {
+        uint8_t param = filters[i].param_max;
+        uint16_t x = 0;
+
+        filter_init(&f, filters[i].type, param);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long n = 0; n < samples; n++)
+        {
+            // Cheap pseudo-random 13-bit input
+            x = (x * 75 + 74) & HIGH;
+            sink = filter_apply(&f, x);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        (void)sink;
+        printf("  %-8s %u  %6.2f ns\n", filters[i].name, param,
+            ((end.tv_sec - start.tv_sec) * 1e9 +
+            (end.tv_nsec - start.tv_nsec)) / samples);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long samples = 10000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                samples = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    test_steps();
+    test_spikes();
+    test_iir_model();
+    benchmark(samples);
+    printf("%s\n", failures ? "FAILED" : "all tests passed");
+    return failures ? 1 : 0;
+}
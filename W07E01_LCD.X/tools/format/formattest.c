@@ -0,0 +1,195 @@
+/*
+ * File:   formattest.c
+ * Tests format.c against snprintf and times both on the host.
+ *
+ * format_u16() is checked against "%*u" for every 16-bit value at widths
+ * 0...7, format_tenths() against a "%d.%u" formatting of every 16-bit 
+ * value, and format_str() for chaining. Writes past the documented buffer
+ * size are caught with guard bytes. Then format_u16() and snprintf() are
+ * timed over all values. The times are host times and only show the
+ * ratio, cycles, flash and stack on the ATmega4809 are measured with 
+ * UART_FORMAT_BENCH in uart.h.
+ *
+ * Usage:   make && ./formattest [-n rounds]
+ *      -n  Rounds over all values in the benchmark (200)
+ * Exits with 1 if any test fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "format.h"
+
+#define GUARD                   0x5A
+#define BUFFER_SIZE             16
+
+static int failures;
+
+static void fail(const char *what, long value, int width, const char *got, 
+    const char *expected)
+{
+    if (failures++ < 10)
+    {
+        printf("  FAIL %s %ld width %d: \"%s\", expected \"%s\"\n", what, 
+            value, width, got, expected);
+    }
+}
+
+// Guard bytes after the room format.h promises must stay untouched
+static int guard_ok(const char *buffer, size_t room)
+{
+    for (size_t i = room; i < BUFFER_SIZE; i++)
+    {
+        if ((uint8_t)buffer[i] != GUARD)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void test_u16(void)
+{
+    char got[BUFFER_SIZE];
+    char expected[BUFFER_SIZE];
+
+    for (int width = 0; width <= 7; width++)
+    {
+        size_t room = ((width > 5) ? width : 5) + 1;
+
+        for (long value = 0; value <= UINT16_MAX; value++)
+        {
+            memset(got, GUARD, sizeof(got));
+            char *end = format_u16(got, (uint16_t)value, width);
+            snprintf(expected, sizeof(expected), "%*u", width, 
+                (unsigned)value);
+            if (strcmp(got, expected) || (end != got + strlen(expected)))
+            {
+                fail("format_u16", value, width, got, expected);
+            }
+            else if (!guard_ok(got, room))
+            {
+                fail("format_u16 overflow", value, width, got, expected);
+            }
+        }
+    }
+    printf("format_u16 checked for all values, widths 0...7\n");
+}
+
+static void test_tenths(void)
+{
+    char got[BUFFER_SIZE];
+    char expected[BUFFER_SIZE];
+
+    for (long value = INT16_MIN + 1; value <= INT16_MAX; value++)
+    {
+        long magnitude = labs(value);
+
+        memset(got, GUARD, sizeof(got));
+        char *end = format_tenths(got, (int16_t)value);
+        snprintf(expected, sizeof(expected), "%s%ld.%ld", 
+            (value < 0) ? "-" : "", magnitude / 10, magnitude % 10);
+        if (strcmp(got, expected) || (end != got + strlen(expected)))
+        {
+            fail("format_tenths", value, 0, got, expected);
+        }
+        else if (!guard_ok(got, 8))
+        {
+            fail("format_tenths overflow", value, 0, got, expected);
+        }
+    }
+    printf("format_tenths checked for %d...%d\n", INT16_MIN + 1, INT16_MAX);
+}
+
+static void test_str(void)
+{
+    char got[BUFFER_SIZE];
+    char *p;
+
+    p = format_str(got, "");
+    p = format_str(p, "POT: ");
+    p = format_u16(p, 1023, 5);
+    p = format_str(p, "!");
+    if (strcmp(got, "POT:  1023!") || (p != got + strlen(got)))
+    {
+        fail("format_str chain", 0, 0, got, "POT:  1023!");
+    }
+    printf("format_str chaining checked\n");
+}
+
+static double seconds(const struct timespec *start, 
+    const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+        (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static void benchmark(long rounds)
+{
+    char number[6];
+    struct timespec start;
+    struct timespec end;
+    double format_s;
+    double snprintf_s;
+    volatile char sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long r = 0; r < rounds; r++)
+    {
+        for (long value = 0; value <= UINT16_MAX; value++)
+        {
+            format_u16(number, (uint16_t)value, 0);
+            sink += number[0];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    format_s = seconds(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long r = 0; r < rounds; r++)
+    {
+        for (long value = 0; value <= UINT16_MAX; value++)
+        {
+            snprintf(number, sizeof(number), "%u", (unsigned)value);
+            sink += number[0];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    snprintf_s = seconds(&start, &end);
+    (void)sink;
+
+    rounds *= UINT16_MAX + 1L;
+    printf("format_u16 %.2f ns, snprintf %.2f ns per number, %.1f times "
+        "faster on the host\n", format_s * 1e9 / rounds, 
+        snprintf_s * 1e9 / rounds, snprintf_s / format_s);
+}
+
+int main(int argc, char *argv[])
+{
+    long rounds = 200;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                rounds = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n rounds]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    test_u16();
+    test_tenths();
+    test_str();
+    benchmark(rounds);
+    printf("%s\n", failures ? "FAILED" : "all tests passed");
+    return failures ? 1 : 0;
+}
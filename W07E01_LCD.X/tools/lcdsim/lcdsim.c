@@ -0,0 +1,680 @@
+/*
+ * File:   lcdsim.c
+ * Host side ST7066U timing emulator for lcd.c.
+ *
+ * lcd.c is compiled for Linux with LCD_SIM defined and a simulated clock:
+ *      - _delay_us() and vTaskDelay() advance the clock
+ *      - the TCB1 interrupt is called whenever its period expires
+ *      - every LCD_BUS_EVENT() in lcd.c costs one CPU cycle
+ * Each RS/RW/E/D[0:7] transition is checked against the ST7066U AC 
+ * characteristics (5 V write cycle) and instruction execution times. When 
+ * lcd.c reads the busy flag, the emulator drives D7 accordingly.
+ *
+ * At the end the smallest margin seen for every kind of wait is printed, 
+ * together with the smallest delay setting that would still have been safe.
+ *
+ * Every latched byte is also logged with its time. After the run the log is
+ * replayed through a model of the DDRAM, the address counter and the 
+ * display shift. The replay checks the gap before every byte against the 
+ * execution time of the byte before it, and compares the visible display 
+ * after every frame with the text the scenario asked for.
+ *
+ * Finally one full line update is timed: from lcd_line_update() to the
+ * controller finishing the last byte, and the timer interrupts it took. The
+ * lcdsim-busy build runs the same with LCD_USE_BUSY_FLAG, make bench 
+ * compares the two at the slowest, typical and fastest oscillator.
+ *
+ * Last, lcd_request() is checked with every opcode against the mailbox
+ * contents it should leave.
+ *
+ * Usage:   make && ./lcdsim [-f fosc_khz] [-v]
+ *      -f  Controller oscillator frequency in kHz. Execution times scale
+ *          with 270 kHz / fosc. Default 270 (datasheet typical value).
+ *      -v  Print every bus transition
+ * Exits with 1 if any timing violation or replay mismatch was found.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+
+// main.h declares the firmware main(), provide just the task handle instead
+#define MAIN_H
+TaskHandle_t lcd_ctrl_handle;
+
+#include "lcd.c"
+
+/******************************************************************************
+ * ST7066U timing, nanoseconds
+ *****************************************************************************/
+#define T_CYCLE_MIN             1200    // tC, E cycle time
+#define T_PW_MIN                460     // tPW, E pulse width
+#define T_AS_MIN                0       // tAS, RS/RW setup before E rise
+#define T_AH_MIN                10      // tAH, RS/RW hold after E fall
+#define T_DSW_MIN               80      // tDSW, data setup before E fall
+#define T_H_MIN                 10      // tH, data hold after E fall
+#define T_POWER_ON              40000000ULL // Vcc > 4,5 V to first command
+#define T_EXEC                  37000ULL    // Most instructions and data
+#define T_EXEC_LONG             1520000ULL  // Clear display, return home
+#define FOSC_TYPICAL_KHZ        270
+
+// Kinds of waits the driver has to get right
+enum wait_kind
+{
+    WAIT_POWER_ON,
+    WAIT_EXEC,
+    WAIT_EXEC_LONG,
+    WAIT_KINDS
+};
+
+static const char *wait_names[WAIT_KINDS] = 
+{
+    "power-on to first command",
+    "after command / data",
+    "after clear / home",
+};
+
+/******************************************************************************
+ * Simulated MCU
+ *****************************************************************************/
+VPORT_t VPORTB, VPORTD;
+PORT_t PORTB, PORTD;
+TCB_t TCB0, TCB1;
+uint8_t SREG;
+
+static uint64_t sim_now;            // ns since power-on
+static int timer_running = 0;
+static uint64_t timer_next;
+static int verbose = 0;
+static unsigned long timer_interrupts = 0;
+static unsigned fosc_khz = FOSC_TYPICAL_KHZ;
+
+static uint64_t ticks_to_ns(uint32_t ticks)
+{
+    return (uint64_t)ticks * 1000000000ULL / configCPU_CLOCK_HZ;
+}
+
+// Run the simulated MCU until t_end, calling the LCD timer interrupt
+// whenever its period expires
+static void sim_run_until(uint64_t t_end)
+{
+    while (1)
+    {
+        if (!timer_running && (LCD_TIMER.CTRLA & TCB_ENABLE_bm))
+        {
+            timer_running = 1;
+            timer_next = sim_now + ticks_to_ns(LCD_TIMER.CCMP + 1);
+        }
+        if (!timer_running || (timer_next > t_end))
+        {
+            break;
+        }
+        if (sim_now < timer_next)
+        {
+            sim_now = timer_next;
+        }
+        TCB1_INT_vect();
+        timer_interrupts++;
+        if (LCD_TIMER.CTRLA & TCB_ENABLE_bm)
+        {
+            // Periodic mode, the counter counts 0...CCMP and restarts
+            timer_next += ticks_to_ns(LCD_TIMER.CCMP + 1);
+        }
+        else
+        {
+            timer_running = 0;
+        }
+    }
+    if (sim_now < t_end)
+    {
+        sim_now = t_end;
+    }
+}
+
+// Let the transmit engine drain everything queued so far
+static void sim_drain(void)
+{
+    while (lcd_tx_head != lcd_tx_tail || timer_running || 
+        (LCD_TIMER.CTRLA & TCB_ENABLE_bm))
+    {
+        sim_run_until(sim_now + 1000000ULL);
+    }
+}
+
+// Like avr-libc, rounded up to whole CPU cycles
+void _delay_us(double us)
+{
+    sim_now += ticks_to_ns((uint32_t)ceil(us * configCPU_CLOCK_HZ / 1e6));
+}
+
+void vTaskDelay(const TickType_t ticks)
+{
+    sim_run_until(sim_now + (uint64_t)ticks * 1000000000ULL / 
+        configTICK_RATE_HZ);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(sim_now * configTICK_RATE_HZ / 1000000000ULL);
+}
+
+uint16_t adc_get(uint8_t input)
+{
+    return 0;
+}
+
+uint16_t adc_to_10bit(uint8_t input, uint16_t value)
+{
+    return value;
+}
+
+void log_write(uint8_t args, uint16_t token, uint16_t a, uint16_t b, 
+    uint16_t c)
+{
+}
+
+/******************************************************************************
+ * ST7066U model
+ *****************************************************************************/
+static struct
+{
+    uint8_t rs, rw, e, d;
+    uint64_t t_addr;        // Last RS/RW change
+    uint64_t t_data;        // Last D[0:7] change
+    uint64_t t_rise;        // Last E rising edge
+    uint64_t t_fall;        // Last E falling edge
+    uint64_t t_write;       // Last byte latched
+    uint64_t busy_until;
+    enum wait_kind waiting; // What busy_until is waiting for
+    int written;            // Any instruction or data written yet
+} bus;
+
+static unsigned violations = 0;
+static unsigned writes = 0;
+
+// Every byte latched by the controller, for the replay
+#define BYTE_LOG_SIZE           8192
+static struct
+{
+    uint64_t t;
+    uint8_t rs;
+    uint8_t d;
+} byte_log[BYTE_LOG_SIZE];
+static unsigned byte_log_count = 0;
+static int64_t min_slack[WAIT_KINDS];
+static unsigned wait_count[WAIT_KINDS];
+
+static void violation(const char *what, uint64_t actual, uint64_t required)
+{
+    if (violations++ < 20)
+    {
+        printf("%12.3f us  VIOLATION %s: %llu ns, needs %llu ns\n", 
+            sim_now / 1000.0, what, (unsigned long long)actual, 
+            (unsigned long long)required);
+    }
+}
+
+static uint64_t exec_time(uint8_t rs, uint8_t d, enum wait_kind *kind)
+{
+    uint64_t t = T_EXEC;
+    
+    *kind = WAIT_EXEC;
+    if (!rs && ((d == 0x01) || ((d & 0xFE) == 0x02)))
+    {
+        t = T_EXEC_LONG;
+        *kind = WAIT_EXEC_LONG;
+    }
+    return t * FOSC_TYPICAL_KHZ / fosc_khz;
+}
+
+// A byte was latched on the E falling edge
+static void lcd_model_write(void)
+{
+    int64_t slack = (int64_t)sim_now - (int64_t)bus.busy_until;
+    enum wait_kind kind = bus.written ? bus.waiting : WAIT_POWER_ON;
+    
+    if (!bus.written)
+    {
+        slack = (int64_t)sim_now - (int64_t)T_POWER_ON;
+        bus.written = 1;
+    }
+    if ((wait_count[kind]++ == 0) || (slack < min_slack[kind]))
+    {
+        min_slack[kind] = slack;
+    }
+    if (slack < 0)
+    {
+        violation(bus.rs ? "data written while busy" : 
+            "command written while busy", 
+            sim_now - bus.t_write, bus.busy_until - bus.t_write);
+    }
+    bus.t_write = sim_now;
+    bus.busy_until = sim_now + exec_time(bus.rs, bus.d, &bus.waiting);
+    writes++;
+    if (byte_log_count < BYTE_LOG_SIZE)
+    {
+        byte_log[byte_log_count].t = sim_now;
+        byte_log[byte_log_count].rs = bus.rs;
+        byte_log[byte_log_count].d = bus.d;
+        byte_log_count++;
+    }
+}
+
+void lcd_sim_bus_event(void)
+{
+    uint8_t rs = (VPORTB.OUT & LCD_RS_PIN) ? 1 : 0;
+    uint8_t rw = (VPORTB.OUT & LCD_RW_PIN) && LCD_USE_BUSY_FLAG ? 1 : 0;
+    uint8_t e = (VPORTB.OUT & LCD_E_PIN) ? 1 : 0;
+    uint8_t d = VPORTD.OUT;
+    
+    // Every bus event is at least one instruction
+    sim_now += ticks_to_ns(1);
+    
+    if ((rs != bus.rs) || (rw != bus.rw))
+    {
+        if (bus.e)
+        {
+            violation("RS/RW changed while E high", 0, 0);
+        }
+        else if (sim_now - bus.t_fall < T_AH_MIN)
+        {
+            violation("tAH address hold", sim_now - bus.t_fall, T_AH_MIN);
+        }
+        bus.t_addr = sim_now;
+    }
+    if ((d != bus.d) && !rw)
+    {
+        if (bus.e)
+        {
+            violation("D[0:7] changed while E high", 0, 0);
+        }
+        else if (sim_now - bus.t_fall < T_H_MIN)
+        {
+            violation("tH data hold", sim_now - bus.t_fall, T_H_MIN);
+        }
+        bus.t_data = sim_now;
+    }
+    if (e && !bus.e)
+    {
+        if (bus.t_rise && (sim_now - bus.t_rise < T_CYCLE_MIN))
+        {
+            violation("tC enable cycle", sim_now - bus.t_rise, T_CYCLE_MIN);
+        }
+        if (sim_now - bus.t_addr < T_AS_MIN)
+        {
+            violation("tAS address setup", sim_now - bus.t_addr, T_AS_MIN);
+        }
+        if (rw)
+        {
+            // Busy flag read, drive D7
+            VPORTD.IN = (sim_now < bus.busy_until) ? 0x80 : 0x00;
+        }
+        bus.t_rise = sim_now;
+    }
+    
+    bus.rs = rs;
+    bus.rw = rw;
+    bus.d = rw ? bus.d : d;
+    
+    if (!e && bus.e)
+    {
+        if (sim_now - bus.t_rise < T_PW_MIN)
+        {
+            violation("tPW enable pulse", sim_now - bus.t_rise, T_PW_MIN);
+        }
+        if (!rw)
+        {
+            if (sim_now - bus.t_data < T_DSW_MIN)
+            {
+                violation("tDSW data setup", sim_now - bus.t_data, T_DSW_MIN);
+            }
+            lcd_model_write();
+        }
+        bus.t_fall = sim_now;
+    }
+    bus.e = e;
+    
+    if (verbose)
+    {
+        printf("%12.3f us  RS=%u RW=%u E=%u D=0x%02X\n", 
+            sim_now / 1000.0, rs, rw, e, d);
+    }
+}
+
+/******************************************************************************
+ * Replay of the byte stream
+ *****************************************************************************/
+// Display contents expected once the first bytes of the log are replayed
+#define CHECKPOINTS             64
+static struct
+{
+    unsigned bytes;
+    char text[LCD_LINES][LCD_COLUMNS];
+} checkpoints[CHECKPOINTS];
+static unsigned checkpoint_count = 0;
+static unsigned replay_errors = 0;
+
+static void replay_error(unsigned i, const char *what)
+{
+    if (replay_errors++ < 20)
+    {
+        printf("%12.3f us  REPLAY byte %u: %s\n", 
+            byte_log[i].t / 1000.0, i, what);
+    }
+}
+
+// Expect the given lines on the display after everything sent so far
+static void checkpoint(const char *line0, const char *line1)
+{
+    const char *lines[LCD_LINES] = {line0, line1};
+    
+    if (checkpoint_count == CHECKPOINTS)
+    {
+        return;
+    }
+    checkpoints[checkpoint_count].bytes = byte_log_count;
+    for (uint8_t line = 0; line < LCD_LINES; line++)
+    {
+        const char *text = lines[line];
+        
+        for (uint8_t col = 0; col < LCD_COLUMNS; col++)
+        {
+            checkpoints[checkpoint_count].text[line][col] = 
+                *text ? *text++ : ' ';
+        }
+    }
+    checkpoint_count++;
+}
+
+// Replays the log, returns the number of errors
+static unsigned replay(void)
+{
+    char ddram[LCD_LINES][LCD_DDRAM_COLUMNS];
+    uint8_t line = 0;
+    uint8_t col = 0;
+    uint8_t view = 0;
+    unsigned next_checkpoint = 0;
+    uint64_t gap_min[WAIT_KINDS] = {0};
+    unsigned gap_count[WAIT_KINDS] = {0};
+    enum wait_kind kind = WAIT_POWER_ON;
+    uint64_t required = T_POWER_ON;
+    
+    memset(ddram, ' ', sizeof(ddram));
+    for (unsigned i = 0; i < byte_log_count; i++)
+    {
+        uint8_t rs = byte_log[i].rs;
+        uint8_t d = byte_log[i].d;
+        uint64_t gap = byte_log[i].t - (i ? byte_log[i - 1].t : 0);
+        
+        // Gap after the previous byte against its execution time
+        if ((gap_count[kind]++ == 0) || (gap < gap_min[kind]))
+        {
+            gap_min[kind] = gap;
+        }
+        if (gap < required)
+        {
+            replay_error(i, "gap shorter than the execution time");
+        }
+        required = exec_time(rs, d, &kind);
+        
+        if (rs)
+        {
+            // Data, the address counter wraps from one line to the other
+            ddram[line][col] = (char)d;
+            if (++col == LCD_DDRAM_COLUMNS)
+            {
+                col = 0;
+                line ^= 1;
+            }
+        }
+        else if (d & 0x80)
+        {
+            // Set DDRAM address
+            line = (d & 0x40) ? 1 : 0;
+            col = d & 0x3F;
+            if (col >= LCD_DDRAM_COLUMNS)
+            {
+                replay_error(i, "DDRAM address outside the line");
+                col = 0;
+            }
+        }
+        else if (d & 0x40)
+        {
+            replay_error(i, "CGRAM address, not used by lcd.c");
+        }
+        else if (d & 0x20)
+        {
+            if ((d & 0x18) != 0x18)
+            {
+                replay_error(i, "function set other than 8 bits, 2 lines");
+            }
+        }
+        else if (d & 0x10)
+        {
+            if (!(d & 0x08))
+            {
+                replay_error(i, "cursor move, not used by lcd.c");
+            }
+            // Display shift, left moves the contents left
+            view = (d & 0x04) ? (view + LCD_DDRAM_COLUMNS - 1) % 
+                LCD_DDRAM_COLUMNS : (view + 1) % LCD_DDRAM_COLUMNS;
+        }
+        else if (d & 0x08)
+        {
+            // Display on/off control, does not change the contents
+        }
+        else if (d & 0x04)
+        {
+            if ((d & 0x03) != 0x02)
+            {
+                replay_error(i, "entry mode other than increment");
+            }
+        }
+        else if (d & 0x02)
+        {
+            // Return home
+            line = 0;
+            col = 0;
+            view = 0;
+        }
+        else if (d & 0x01)
+        {
+            // Clear display
+            memset(ddram, ' ', sizeof(ddram));
+            line = 0;
+            col = 0;
+            view = 0;
+        }
+        
+        // Compare the visible display after the last byte of a frame
+        while ((next_checkpoint < checkpoint_count) && 
+            (checkpoints[next_checkpoint].bytes == i + 1))
+        {
+            for (uint8_t l = 0; l < LCD_LINES; l++)
+            {
+                for (uint8_t c = 0; c < LCD_COLUMNS; c++)
+                {
+                    if (ddram[l][(view + c) % LCD_DDRAM_COLUMNS] != 
+                        checkpoints[next_checkpoint].text[l][c])
+                    {
+                        replay_error(i, "display differs from the request");
+                        l = LCD_LINES;
+                        break;
+                    }
+                }
+            }
+            next_checkpoint++;
+        }
+    }
+    if (byte_log_count == BYTE_LOG_SIZE)
+    {
+        printf("  byte log full, replayed only the first %u bytes\n", 
+            BYTE_LOG_SIZE);
+    }
+    
+    printf("Replay, %u bytes, %u frames compared\n", byte_log_count, 
+        next_checkpoint);
+    for (uint8_t k = 0; k < WAIT_KINDS; k++)
+    {
+        if (gap_count[k])
+        {
+            printf("  gap %-26s  %5u gaps, shortest %10.3f us\n", 
+                wait_names[k], gap_count[k], gap_min[k] / 1000.0);
+        }
+    }
+    return replay_errors;
+}
+
+/******************************************************************************
+ * Scenario and report
+ *****************************************************************************/
+/******************************************************************************
+ * Request opcodes
+ *****************************************************************************/
+static unsigned request_errors = 0;
+
+// Compare the mailbox of a line with the text expected after a request
+static void check_mailbox(uint8_t line, const char *what, const char *expected,
+    uint8_t dirty)
+{
+    if (memcmp(lcd_mailboxes[line].text, expected, LCD_COLUMNS) || 
+        (lcd_mailboxes[line].dirty != dirty))
+    {
+        printf("  REQUEST %s: line %u is \"%.16s\", expected \"%s\"\n", what, 
+            line, lcd_mailboxes[line].text, expected);
+        request_errors++;
+    }
+    lcd_mailboxes[line].dirty = 0;
+}
+
+// Apply every opcode to the mailboxes the way producers send them
+static void check_requests(void)
+{
+    lcd_mailbox_init();
+    lcd_request(LCD_OP_LINE, 0, 0, "LDR value: 1023");
+    check_mailbox(0, "line", "LDR value: 1023 ", 1);
+    lcd_request(LCD_OP_TEXT, 0, 11, "42  ");
+    check_mailbox(0, "text", "LDR value: 42   ", 1);
+    lcd_request(LCD_OP_TEXT, 0, 14, "xyz");
+    check_mailbox(0, "text clipped at the end", "LDR value: 42 xy", 1);
+    lcd_request(LCD_OP_TEXT, 0, 16, "x");
+    check_mailbox(0, "text past the end", "LDR value: 42 xy", 1);
+    lcd_request(LCD_OP_LINE, 1, 0, "a line longer than the display");
+    check_mailbox(1, "line clipped", "a line longer th", 1);
+    lcd_request(LCD_OP_BANNER, 1, LCD_BANNER_MAX_INDEX, NULL);
+    check_mailbox(1, "banner", &MANUFACTURER_TEXT[LCD_BANNER_MAX_INDEX], 1);
+    check_mailbox(0, "other line untouched", "LDR value: 42 xy", 0);
+}
+
+static void report_line(enum wait_kind kind, double configured_us)
+{
+    if (wait_count[kind] == 0)
+    {
+        printf("  %-26s  not exercised\n", wait_names[kind]);
+        return;
+    }
+    double slack_us = min_slack[kind] / 1000.0;
+    printf("  %-26s  %5u waits, min margin %10.3f us", 
+        wait_names[kind], wait_count[kind], slack_us);
+    if (configured_us > 0)
+    {
+        // Rounded up to whole microseconds
+        double safe_us = configured_us - slack_us;
+        long safe = (long)safe_us;
+        if (safe < safe_us)
+        {
+            safe++;
+        }
+        printf(", smallest safe setting %ld us (now %.0f us)", 
+            safe, configured_us);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "f:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                fosc_khz = (unsigned)atoi(optarg);
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-f fosc_khz] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (fosc_khz == 0)
+    {
+        fprintf(stderr, "fosc must be > 0\n");
+        return 2;
+    }
+    
+    // Power-on, initialization and a typical mix of updates: report line
+    // changes, banner scrolling and a clear followed straight by text
+    lcd_init();
+    sim_drain();
+    for (uint8_t i = 0; i < 2 * LCD_BANNER_MAX_INDEX; i++)
+    {
+        char text[LCD_COLUMNS + 1];
+        char window[LCD_COLUMNS + 1];
+        uint8_t offset = (i <= LCD_BANNER_MAX_INDEX) ? 
+            i : 2 * LCD_BANNER_MAX_INDEX - i;
+        
+        format_u16(format_str(text, "LDR value: "), 997 + 7 * i, 0);
+        lcd_line_update(0, text);
+        lcd_banner_window(window, offset);
+        window[LCD_COLUMNS] = '\0';
+        lcd_line_update(1, window);
+        vTaskDelay(pdMS_TO_TICKS(200));
+        checkpoint(text, window);
+    }
+    lcd_clear();
+    lcd_line_update(0, "after clear");
+    sim_drain();
+    checkpoint("after clear", "");
+    
+    // Traffic of the scenario, the same counts lcd_control logs
+    struct lcd_stats stats;
+    lcd_stats_get(&stats);
+    printf("ST7066U timing, fosc %u kHz, CPU %lu Hz, %u bytes written\n", 
+        fosc_khz, (unsigned long)configCPU_CLOCK_HZ, writes);
+    printf("  line updates sent %lu bytes, full rewrites would have sent "
+        "%lu (%.0f %%)\n", (unsigned long)stats.bytes_written, 
+        (unsigned long)stats.bytes_requested, 
+        100.0 * stats.bytes_written / stats.bytes_requested);
+    report_line(WAIT_POWER_ON, LCD_POWER_ON_DELAY_MS * 1000.0);
+    report_line(WAIT_EXEC, LCD_USE_BUSY_FLAG ? 0 : LCD_CMD_DELAY_US);
+    report_line(WAIT_EXEC_LONG, LCD_USE_BUSY_FLAG ? 0 : LCD_CLEAR_DELAY_US);
+    replay();
+    
+    // Full rewrite of a line, every column changes
+    lcd_line_update(0, "abcdefghijklmnop");
+    sim_drain();
+    checkpoint("abcdefghijklmnop", "");
+    uint64_t t_update = sim_now;
+    unsigned long interrupts = timer_interrupts;
+    lcd_line_update(0, "ABCDEFGHIJKLMNOP");
+    sim_drain();
+    checkpoint("ABCDEFGHIJKLMNOP", "");
+    lcd_stats_get(&stats);
+    printf("%s, fosc %u kHz: line update %.1f us, %lu timer interrupts, "
+        "lcd_stats %lu us\n", LCD_USE_BUSY_FLAG ? "busy flag" : 
+        "fixed delays", fosc_khz, (bus.busy_until - t_update) / 1000.0, 
+        timer_interrupts - interrupts, (unsigned long)stats.last_burst_us);
+    check_requests();
+    printf("%u timing violations, %u replay errors, %u request errors\n", 
+        violations, replay_errors, request_errors);
+    
+    return (violations || replay_errors || request_errors) ? 1 : 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Just enough of the FreeRTOS API for the host build of lcd.c. The timing
+ * emulator runs lcd.c single-threaded, so scheduler locking and task
+ * notifications are no-ops.
+ */
+
+#ifndef LCDSIM_FREERTOS_H
+#define LCDSIM_FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint16_t TickType_t;
+typedef uint8_t UBaseType_t;
+typedef void *TaskHandle_t;
+
+#define portMAX_DELAY           ((TickType_t)0xFFFF)
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+void vTaskDelay(const TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+#define vTaskDelete(task)       ((void)(task))
+#define pdTRUE                  1
+
+static inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{ return 0; }
+static inline void vTaskSuspendAll(void) { }
+static inline int xTaskResumeAll(void) { return 0; }
+static inline int xTaskNotifyGive(TaskHandle_t task) { return 1; }
+static inline uint32_t ulTaskNotifyTake(int clear, TickType_t ticks) 
+{ return 0; }
+
+#endif /* LCDSIM_FREERTOS_H */
@@ -0,0 +1,4 @@
+/* ISR() is provided by the <avr/io.h> stub */
+#include <avr/io.h>
+
+#define cli()
@@ -0,0 +1,62 @@
+/*
+ * Minimal <avr/io.h> for the host build of lcd.c. Only the registers and
+ * bit masks that lcd.c touches are defined.
+ */
+
+#ifndef LCDSIM_AVR_IO_H
+#define LCDSIM_AVR_IO_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    volatile uint8_t DIR;
+    volatile uint8_t OUT;
+    volatile uint8_t IN;
+    volatile uint8_t INTFLAGS;
+} VPORT_t;
+
+typedef struct
+{
+    volatile uint8_t DIR;
+    volatile uint8_t DIRSET;
+    volatile uint8_t DIRCLR;
+    volatile uint8_t OUT;
+    volatile uint8_t OUTSET;
+    volatile uint8_t OUTCLR;
+} PORT_t;
+
+typedef struct
+{
+    volatile uint8_t CTRLA;
+    volatile uint8_t CTRLB;
+    volatile uint8_t EVCTRL;
+    volatile uint8_t INTCTRL;
+    volatile uint8_t INTFLAGS;
+    volatile uint16_t CNT;
+    volatile uint16_t CCMP;
+} TCB_t;
+
+extern VPORT_t VPORTB, VPORTD;
+extern PORT_t PORTB, PORTD;
+extern TCB_t TCB0, TCB1;
+extern uint8_t SREG;
+
+#define PIN0_bm                 0x01
+#define PIN1_bm                 0x02
+#define PIN2_bm                 0x04
+#define PIN3_bm                 0x08
+#define PIN4_bm                 0x10
+#define PIN5_bm                 0x20
+#define PIN6_bm                 0x40
+#define PIN7_bm                 0x80
+
+#define TCB_ENABLE_bm           0x01
+#define TCB_CLKSEL_CLKDIV1_gc   0x00
+#define TCB_CNTMODE_INT_gc      0x00
+#define TCB_CAPT_bm             0x01
+
+#define ISR(vector)             void vector(void)
+#define TCB1_INT_vect           lcdsim_tcb1_isr
+
+#endif /* LCDSIM_AVR_IO_H */
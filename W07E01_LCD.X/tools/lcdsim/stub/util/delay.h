@@ -0,0 +1,2 @@
+/* Busy-wait delays advance the simulated clock, see lcdsim.c */
+void _delay_us(double us);
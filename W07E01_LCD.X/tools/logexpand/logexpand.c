@@ -0,0 +1,298 @@
+/*
+ * File:   logexpand.c
+ * Expands the tokenized log records of log.c into text.
+ *
+ * The format strings are looked up from the ELF file of the firmware: every
+ * log_fmt.* symbol is a format string in flash, and its address is the 
+ * token in the records. The records come in TELEMETRY_LOG frames, read 
+ * with tools/telemetry/frames.c. Text between the frames is passed through
+ * as is, so the text reports stay readable, and other frames are skipped.
+ * A frame that fails its CRC is dropped as a whole, so a broken record is
+ * never expanded.
+ *
+ * Usage:   make && stty -F /dev/ttyACM0 115200 raw && 
+ *          ./logexpand firmware.elf < /dev/ttyACM0
+ *      or  ./logexpand firmware.elf uart.bin
+ * The ELF file of an MPLAB X build is 
+ *      dist/default/production/W07E01_LCD.X.production.elf
+ * and must come from the same build as the running firmware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "frames.h"
+
+// Same as in log.h
+#define LOG_RECORD              0xF0
+#define LOG_ARGS_MAX            3
+
+#define SHT_SYMTAB              2
+#define TOKENS_MAX              256
+
+struct token
+{
+    uint16_t token;
+    const char *fmt;
+};
+
+static struct token tokens[TOKENS_MAX];
+static int token_count;
+
+static uint16_t get16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Collects the log_fmt.* symbols of a 32-bit little-endian ELF file (AVR)
+static int elf_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *elf;
+    long size;
+    
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    elf = malloc(size);
+    if (!elf || fread(elf, 1, size, f) != (size_t)size)
+    {
+        fprintf(stderr, "%s: read failed\n", path);
+        return -1;
+    }
+    fclose(f);
+    if (size < 52 || memcmp(elf, "\177ELF\1\1", 6) != 0)
+    {
+        fprintf(stderr, "%s: not a 32-bit little-endian ELF file\n", path);
+        return -1;
+    }
+    
+    uint32_t shoff = get32(elf + 0x20);
+    uint16_t shentsize = get16(elf + 0x2E);
+    uint16_t shnum = get16(elf + 0x30);
+    const uint8_t *sections = elf + shoff;
+    
+    if (shoff + (uint32_t)shnum * shentsize > (uint32_t)size)
+    {
+        fprintf(stderr, "%s: broken section table\n", path);
+        return -1;
+    }
+    for (int i = 0; i < shnum; i++)
+    {
+        const uint8_t *symtab = sections + i * shentsize;
+        
+        if (get32(symtab + 4) != SHT_SYMTAB)
+        {
+            continue;
+        }
+        const uint8_t *strtab = sections + get32(symtab + 24) * shentsize;
+        const char *names = (const char *)elf + get32(strtab + 16);
+        const uint8_t *sym = elf + get32(symtab + 16);
+        const uint8_t *end = sym + get32(symtab + 20);
+        
+        for (; sym < end; sym += 16)
+        {
+            const char *name = names + get32(sym);
+            uint32_t value = get32(sym + 4);
+            uint16_t shndx = get16(sym + 14);
+            
+            if (strncmp(name, "log_fmt", 7) != 0 || shndx == 0 || 
+                shndx >= shnum)
+            {
+                continue;
+            }
+            // The string is in the section of the symbol
+            const uint8_t *section = sections + shndx * shentsize;
+            uint32_t offset = get32(section + 16) + value - get32(section + 12);
+            
+            if (offset >= (uint32_t)size || token_count == TOKENS_MAX)
+            {
+                continue;
+            }
+            tokens[token_count].token = value;
+            tokens[token_count].fmt = (const char *)elf + offset;
+            token_count++;
+        }
+    }
+    if (token_count == 0)
+    {
+        fprintf(stderr, "%s: no log_fmt symbols, is it stripped?\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static const char *token_find(uint16_t token)
+{
+    for (int i = 0; i < token_count; i++)
+    {
+        if (tokens[i].token == token)
+        {
+            return tokens[i].fmt;
+        }
+    }
+    return NULL;
+}
+
+// Prints fmt with 16-bit arguments as printf would on the AVR
+static void expand(const char *fmt, const uint16_t *args, int arg_count)
+{
+    char spec[16];
+    int arg = 0;
+    
+    while (*fmt)
+    {
+        if (*fmt != '%')
+        {
+            putchar(*fmt++);
+            continue;
+        }
+        const char *start = fmt++;
+        
+        fmt += strspn(fmt, "-+ #0");
+        fmt += strspn(fmt, "0123456789");
+        fmt += strspn(fmt, "h");
+        
+        int len = fmt - start;
+        uint16_t value = arg < arg_count ? args[arg] : 0;
+        
+        if (*fmt == '\0' || len >= (int)sizeof(spec) - 1)
+        {
+            fputs(start, stdout);
+            break;
+        }
+        // The h modifiers are dropped, the value is passed as an int
+        memcpy(spec, start, len);
+        spec[len] = *fmt;
+        spec[len + 1] = '\0';
+        for (char *h; (h = strchr(spec, 'h'));)
+        {
+            memmove(h, h + 1, strlen(h));
+        }
+        switch (*fmt)
+        {
+            case 'd':
+            case 'i':
+                printf(spec, (int)(int16_t)value);
+                arg++;
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                printf(spec, (unsigned)value);
+                arg++;
+                break;
+            case 'c':
+                printf(spec, value & 0xFF);
+                arg++;
+                break;
+            case '%':
+                putchar('%');
+                break;
+            default:
+                // Not supported, printed as it is
+                fwrite(start, 1, fmt - start + 1, stdout);
+                break;
+        }
+        fmt++;
+    }
+}
+
+// Prints the records of one TELEMETRY_LOG frame
+static void records_print(const uint8_t *p, int len)
+{
+    uint16_t args[LOG_ARGS_MAX];
+    const char *fmt;
+    
+    while (len > 0)
+    {
+        int arg_count = p[0] & LOG_ARGS_MAX;
+        int record_len = 3 + 2 * arg_count;
+        
+        if ((p[0] & ~LOG_ARGS_MAX) != LOG_RECORD || record_len > len)
+        {
+            printf("[log] broken record, %d bytes skipped\n", len);
+            return;
+        }
+        uint16_t token = get16(p + 1);
+        for (int i = 0; i < arg_count; i++)
+        {
+            args[i] = get16(p + 3 + 2 * i);
+        }
+        
+        if (token == 0 && arg_count == 1)
+        {
+            printf("[log] %u records dropped\n", args[0]);
+        }
+        else if ((fmt = token_find(token)))
+        {
+            fputs("[log] ", stdout);
+            expand(fmt, args, arg_count);
+            putchar('\n');
+        }
+        else
+        {
+            printf("[log] unknown token 0x%04X, is the ELF file from the "
+                "running build?\n", token);
+        }
+        p += record_len;
+        len -= record_len;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static struct frame f;
+    struct frame_reader reader;
+    FILE *in = stdin;
+    
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s firmware.elf [uart.bin]\n", argv[0]);
+        return 1;
+    }
+    if (elf_load(argv[1]) != 0)
+    {
+        return 1;
+    }
+    if (argc == 3 && !(in = fopen(argv[2], "rb")))
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    
+    frame_reader_init(&reader, in);
+    while (frame_read(&reader, &f))
+    {
+        if (f.type == FRAME_TEXT)
+        {
+            fwrite(f.data, 1, f.len, stdout);
+        }
+        else if (f.type == TELEMETRY_LOG)
+        {
+            records_print(f.data, f.len);
+        }
+        else
+        {
+            continue;
+        }
+        fflush(stdout);
+    }
+    if (reader.bad)
+    {
+        fprintf(stderr, "%lu broken frames skipped\n", reader.bad);
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * File:   ntcbench.c
+ * Checks ntc_temperature() of ntc.c against the float model and times both.
+ *
+ * Every 10-bit code is converted with ntc.c and with the model in
+ * ntcmodel.h. Codes within NTC_CODE_MIN...NTC_CODE_MAX must be within the
+ * allowed error of the model, the others must give NTC_OUT_OF_RANGE. Then
+ * both conversions are timed over all codes. The times are host times,
+ * they show the ratio of the table to log() but not the cycles on the
+ * ATmega4809, where log() is a software float routine.
+ *
+ * Usage:   make ntcbench && ./ntcbench [-e max_error] [-n rounds]
+ *      -e  Largest allowed error in 0,1 C (2)
+ *      -n  Rounds over all codes in the benchmark (20000)
+ * Exits with 1 if a code is converted wrong.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ntc.h"
+#include "ntc_table.h"
+#include "ntcmodel.h"
+
+static double seconds(const struct timespec *start, 
+    const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+        (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    double max_allowed = 2;
+    double max_error = 0;
+    long rounds = 20000;
+    unsigned max_error_code = 0;
+    unsigned failures = 0;
+    struct timespec start;
+    struct timespec end;
+    double table_s;
+    double model_s;
+    volatile int32_t table_sum = 0;
+    volatile double model_sum = 0;
+    uint16_t code;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'e': max_allowed = atof(optarg); break;
+            case 'n': rounds = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-e max_error] [-n rounds]\n",
+                    argv[0]);
+                return 2;
+        }
+    }
+
+    for (code = 0; code < ADC_CODES; code++)
+    {
+        int16_t t = ntc_temperature(code);
+        int valid = (code >= NTC_CODE_MIN) && (code <= NTC_CODE_MAX);
+        double error;
+
+        if (!valid)
+        {
+            if (t != NTC_OUT_OF_RANGE)
+            {
+                printf("code %u out of range but gave %d\n", code, t);
+                failures++;
+            }
+            continue;
+        }
+        error = fabs(t - model_temp(code + 0.5));
+        if ((t == NTC_OUT_OF_RANGE) || (error > max_allowed))
+        {
+            printf("code %u gave %d, model %.1f\n", code, t,
+                model_temp(code + 0.5));
+            failures++;
+        }
+        if (error > max_error)
+        {
+            max_error = error;
+            max_error_code = code;
+        }
+    }
+    printf("codes %u...%u (%.1f...%.1f C), largest error %.2f (0,1 C) at "
+        "code %u\n", NTC_CODE_MIN, NTC_CODE_MAX,
+        model_temp(NTC_CODE_MAX + 0.5) / 10,
+        model_temp(NTC_CODE_MIN + 0.5) / 10, max_error, max_error_code);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long r = 0; r < rounds; r++)
+    {
+        for (code = NTC_CODE_MIN; code <= NTC_CODE_MAX; code++)
+        {
+            table_sum += ntc_temperature(code);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    table_s = seconds(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long r = 0; r < rounds; r++)
+    {
+        for (code = NTC_CODE_MIN; code <= NTC_CODE_MAX; code++)
+        {
+            model_sum += model_temp(code + 0.5);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    model_s = seconds(&start, &end);
+
+    rounds *= NTC_CODE_MAX - NTC_CODE_MIN + 1;
+    printf("table %.2f ns, float model %.2f ns per conversion, %.1f times "
+        "faster on the host\n", table_s * 1e9 / rounds,
+        model_s * 1e9 / rounds, model_s / table_s);
+    printf("%s\n", failures ? "FAILED" : "all codes correct");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * File:   ntcmodel.h
+ * Float model of the NTC divider, shared by ntctable and ntcbench.
+ *
+ * The thermistor follows the beta model
+ *      1/T = 1/T25 + ln(R/R25)/B
+ * and sits in a voltage divider with a fixed resistor, read by the 10-bit
+ * ADC against its reference voltage. The defaults are the parts of the
+ * board, the programs change them from their options.
+ */
+
+#ifndef NTCMODEL_H
+#define NTCMODEL_H
+
+#include <math.h>
+
+#define ADC_CODES               1024
+#define KELVIN                  273.15
+#define TEMP_MIN                (-400)  // Table is clamped to -40,0 C...
+#define TEMP_MAX                1500    // ...150,0 C
+
+static double r25 = 10000;
+static double beta = 3950;
+static double r_fixed = 10000;
+static double vdd = 3300;
+static double vref = 2500;
+static int high_side = 0;
+
+// Temperature in 0,1 C of the given (fractional) ADC code
+static double model_temp(double code)
+{
+    double v = code * vref / ADC_CODES;
+    double r;
+
+    if (v <= 0)
+    {
+        return high_side ? TEMP_MIN : TEMP_MAX;
+    }
+    if (v >= vdd)
+    {
+        return high_side ? TEMP_MAX : TEMP_MIN;
+    }
+    r = high_side ? r_fixed * (vdd - v) / v : r_fixed * v / (vdd - v);
+    return 10 * (1 / (1 / (KELVIN + 25) + log(r / r25) / beta) - KELVIN);
+}
+
+#endif /* NTCMODEL_H */
@@ -0,0 +1,192 @@
+/*
+ * File:   ntctable.c
+ * Generates ntc_table.h, the ADC reading to temperature table of ntc.c.
+ *
+ * The table holds the temperature of the model in ntcmodel.h in 0,1 C at
+ * every 2^step:th ADC code. ntc.c interpolates linearly between the 
+ * entries.
+ *
+ * The interpolation is checked against the float model at every ADC code.
+ * The valid range is the codes around 25 C where the error stays within the
+ * allowed error, but never the lowest and the highest code, where the ADC
+ * saturates. ntc.c reports readings outside the range as out of range. The
+ * range and the largest error are printed to stderr.
+ *
+ * Usage:   make && ./ntctable [options] > ../../ntc_table.h
+ *      -r  R25, thermistor resistance at 25 C in ohms (10000)
+ *      -b  B constant in kelvins (3950)
+ *      -s  Fixed resistor in ohms (10000)
+ *      -d  Divider supply voltage in millivolts (3300)
+ *      -v  ADC reference voltage in millivolts (2500)
+ *      -H  Thermistor on the high side of the divider (default low side)
+ *      -n  Table step as a power of two ADC codes (4 = every 16th code)
+ *      -l  Lowest temperature the range must reach, C (5)
+ *      -h  Highest temperature the range must reach, C (100)
+ *      -e  Largest allowed error in 0,1 C (2)
+ * Exits with 1 if the valid range does not reach from -l to -h.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "ntcmodel.h"
+
+static int16_t clamp_temp(double t)
+{
+    if (t < TEMP_MIN)
+    {
+        return TEMP_MIN;
+    }
+    if (t > TEMP_MAX)
+    {
+        return TEMP_MAX;
+    }
+    return (int16_t)lround(t);
+}
+
+// Prints a temperature in 0,1 C with a decimal comma
+static void print_tenths(double t)
+{
+    long tenths = lround(t);
+    
+    printf("%s%ld,%ld", (tenths < 0) ? "-" : "", labs(tenths) / 10, 
+        labs(tenths) % 10);
+}
+
+// Same interpolation as ntc_temperature() in ntc.c
+static int16_t table_temp(const int16_t *table, unsigned step, uint16_t code)
+{
+    uint16_t i = code >> step;
+    uint8_t frac = code & ((1 << step) - 1);
+    int16_t t = table[i];
+    
+    return t + ((int16_t)((table[i + 1] - t) * frac) >> step);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned step = 4;
+    double check_low = 5;
+    double check_high = 100;
+    double max_allowed = 2;
+    double max_error = 0;
+    double error[ADC_CODES];
+    double t_low;
+    double t_high;
+    int16_t table[ADC_CODES + 1];
+    unsigned entries;
+    unsigned i;
+    unsigned code_min;
+    unsigned code_max;
+    unsigned center = 1;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "r:b:s:d:v:Hn:l:h:e:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r': r25 = atof(optarg); break;
+            case 'b': beta = atof(optarg); break;
+            case 's': r_fixed = atof(optarg); break;
+            case 'd': vdd = atof(optarg); break;
+            case 'v': vref = atof(optarg); break;
+            case 'H': high_side = 1; break;
+            case 'n': step = (unsigned)atoi(optarg); break;
+            case 'l': check_low = atof(optarg); break;
+            case 'h': check_high = atof(optarg); break;
+            case 'e': max_allowed = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-r r25] [-b beta] [-s r_fixed] "
+                    "[-d vdd_mv] [-v vref_mv] [-H] [-n step] [-l low_c] "
+                    "[-h high_c] [-e max_error]\n", argv[0]);
+                return 2;
+        }
+    }
+    if ((step < 1) || (step > 7))
+    {
+        fprintf(stderr, "step must be 1...7\n");
+        return 2;
+    }
+    
+    // Entry i is the temperature at the middle of code i * 2^step
+    entries = (ADC_CODES >> step) + 1;
+    for (i = 0; i < entries; i++)
+    {
+        table[i] = clamp_temp(model_temp((i << step) + 0.5));
+    }
+    
+    // ntc.c multiplies the difference of two entries by the step in 16 bits
+    for (i = 0; i + 1 < entries; i++)
+    {
+        if (abs(table[i + 1] - table[i]) * ((1 << step) - 1) > INT16_MAX)
+        {
+            fprintf(stderr, "entries %u and %u too far apart for step %u\n",
+                i, i + 1, step);
+            return 1;
+        }
+    }
+    
+    // Compare the interpolation to the model at every code
+    for (i = 0; i < ADC_CODES; i++)
+    {
+        error[i] = fabs(table_temp(table, step, (uint16_t)i) - 
+            model_temp(i + 0.5));
+        if (fabs(model_temp(i + 0.5) - 250) < 
+            fabs(model_temp(center + 0.5) - 250))
+        {
+            center = i;
+        }
+    }
+    
+    // Valid range around 25 C, without the saturated codes at both ends
+    code_min = center;
+    code_max = center;
+    while ((code_min > 1) && (error[code_min - 1] <= max_allowed))
+    {
+        code_min--;
+    }
+    while ((code_max < ADC_CODES - 2) && (error[code_max + 1] <= max_allowed))
+    {
+        code_max++;
+    }
+    for (i = code_min; i <= code_max; i++)
+    {
+        max_error = (error[i] > max_error) ? error[i] : max_error;
+    }
+    t_low = fmin(model_temp(code_min + 0.5), model_temp(code_max + 0.5));
+    t_high = fmax(model_temp(code_min + 0.5), model_temp(code_max + 0.5));
+    
+    printf("/*\n");
+    printf(" * File:   ntc_table.h\n");
+    printf(" * Generated by tools/ntctable, do not edit.\n");
+    printf(" *      ./ntctable -r %.0f -b %.0f -s %.0f -d %.0f -v %.0f%s -n %u\n",
+        r25, beta, r_fixed, vdd, vref, high_side ? " -H" : "", step);
+    printf(" * Temperature in 0,1 C at every %u:th 10-bit ADC code.\n", 
+        1u << step);
+    printf(" * Valid from code %u to %u (", code_min, code_max);
+    print_tenths(t_low);
+    printf(" C to ");
+    print_tenths(t_high);
+    printf(" C), error within ");
+    print_tenths(max_allowed);
+    printf(" C.\n");
+    printf(" */\n\n");
+    printf("#ifndef NTC_TABLE_H\n#define NTC_TABLE_H\n\n");
+    printf("#define NTC_TABLE_STEP %u\n", step);
+    printf("#define NTC_CODE_MIN %u\n", code_min);
+    printf("#define NTC_CODE_MAX %u\n\n", code_max);
+    printf("static const __flash int16_t ntc_table[%u] =\n{", entries);
+    for (i = 0; i < entries; i++)
+    {
+        printf("%s%6d,", (i % 8) ? "" : "\n   ", table[i]);
+    }
+    printf("\n};\n\n#endif /* NTC_TABLE_H */\n");
+    
+    fprintf(stderr, "%u entries, %u bytes, valid from code %u to %u, "
+        "%.1f...%.1f C, largest error %.2f (0,1 C)\n", entries, entries * 2,
+        code_min, code_max, t_low / 10, t_high / 10, max_error);
+    return ((t_low > check_low * 10) || (t_high < check_high * 10)) ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * File:   capture2csv.c
+ * Decodes the capture blocks of capture.c into CSV.
+ *
+ * The stream is read with frames.c, and every valid TELEMETRY_CAPTURE 
+ * frame is unpacked (see capture.h) into one line per sample
+ *      sample,value
+ * where sample counts the sample periods since the first block received.
+ * Samples dropped by the firmware (the overrun count) and blocks lost on
+ * the way (the sequence number) leave gaps in the sample column, so the 
+ * values stay at their right time. Other frames and text are skipped. 
+ * Block, lost and bad counts are printed to stderr at the end.
+ *
+ * Usage:   make capture2csv && stty -F /dev/ttyACM0 115200 raw && 
+ *          ./capture2csv < /dev/ttyACM0 > capture.csv
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "frames.h"
+#include "capture.h"
+
+static unsigned long blocks;
+static unsigned long bad_blocks;
+static unsigned long lost_blocks;
+
+// Reads a varint, returns -1 if it runs past the end or over 16 bits
+static long varint(const uint8_t **p, const uint8_t *end)
+{
+    long value = 0;
+    
+    for (int shift = 0; *p < end && shift < 21; shift += 7)
+    {
+        uint8_t byte = *(*p)++;
+        
+        value |= (long)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return (value <= 0xFFFF) ? value : -1;
+        }
+    }
+    return -1;
+}
+
+static void block_decode(const uint8_t *buf, int len)
+{
+    static int started;
+    static uint8_t prev_seq;
+    static long prev_overruns;
+    static unsigned long sample;
+    const uint8_t *p = buf + 1;
+    const uint8_t *end = buf + len;
+    uint16_t values[CAPTURE_BLOCK_SAMPLES];
+    long overruns;
+    long v;
+    uint8_t seq;
+    
+    if (len < 1)
+    {
+        bad_blocks++;
+        return;
+    }
+    seq = buf[0];
+    overruns = varint(&p, end);
+    v = varint(&p, end);
+    if (overruns < 0 || v < 0)
+    {
+        bad_blocks++;
+        return;
+    }
+    values[0] = v;
+    for (int i = 1; i < CAPTURE_BLOCK_SAMPLES; i++)
+    {
+        v = varint(&p, end);
+        if (v < 0)
+        {
+            bad_blocks++;
+            return;
+        }
+        // Undo the zigzag encoding of the difference
+        values[i] = values[i - 1] + (uint16_t)((v >> 1) ^ -(v & 1));
+    }
+    if (p != end)
+    {
+        bad_blocks++;
+        return;
+    }
+    
+    if (started)
+    {
+        unsigned lost = (uint8_t)(seq - prev_seq - 1);
+        
+        lost_blocks += lost;
+        sample += (unsigned long)lost * CAPTURE_BLOCK_SAMPLES;
+        // Overruns restart from 0 when capture is started again
+        if (overruns >= prev_overruns)
+        {
+            sample += (uint16_t)(overruns - prev_overruns);
+        }
+    }
+    started = 1;
+    prev_seq = seq;
+    prev_overruns = overruns;
+    blocks++;
+    
+    for (int i = 0; i < CAPTURE_BLOCK_SAMPLES; i++)
+    {
+        printf("%lu,%u\n", sample++, values[i]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    struct frame_reader reader;
+    struct frame frame;
+    
+    if (argc > 1 && !(in = fopen(argv[1], "rb")))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    frame_reader_init(&reader, in);
+    printf("sample,value\n");
+    while (frame_read(&reader, &frame))
+    {
+        if (frame.type == TELEMETRY_CAPTURE)
+        {
+            block_decode(frame.data, frame.len);
+            fflush(stdout);
+        }
+    }
+    fprintf(stderr, "%lu blocks, %lu lost, %lu bad\n", blocks, lost_blocks, 
+        reader.bad + bad_blocks);
+    return 0;
+}
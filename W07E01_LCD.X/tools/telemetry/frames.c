@@ -0,0 +1,132 @@
+/*
+ * File:   frames.c
+ * Frame reader for the host tools, see frames.h.
+ */
+
+#include <string.h>
+#include "frames.h"
+
+void frame_reader_init(struct frame_reader *r, FILE *in)
+{
+    memset(r, 0, sizeof(*r));
+    r->in = in;
+}
+
+// Decodes COBS in place. Returns the decoded length, or -1 if the piece is
+// not valid COBS.
+static int cobs_decode(uint8_t *buf, int len)
+{
+    int in = 0;
+    int out = 0;
+    
+    while (in < len)
+    {
+        int code = buf[in++];
+        
+        if (code == 0 || in + code - 1 > len)
+        {
+            return -1;
+        }
+        for (int i = 1; i < code; i++)
+        {
+            buf[out++] = buf[in++];
+        }
+        // A code below 255 stands for a zero, except at the end
+        if (code < 0xFF && in < len)
+        {
+            buf[out++] = 0;
+        }
+    }
+    return out;
+}
+
+static int is_text(const uint8_t *buf, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        if ((buf[i] < 0x20 || buf[i] > 0x7E) && buf[i] != '\r' && 
+            buf[i] != '\n' && buf[i] != '\t')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Turns a piece of the stream into a frame or text. Returns 0 if it is
+// neither.
+static int piece_decode(struct frame_reader *r, struct frame *f, int len)
+{
+    uint8_t piece[FRAME_CHUNK_MAX];
+    int decoded;
+    
+    memcpy(piece, f->data, len);
+    decoded = cobs_decode(piece, len);
+    if (decoded >= 3 && decoded - 3 <= TELEMETRY_PAYLOAD_MAX && 
+        telemetry_crc16(0xFFFF, piece, decoded - 2) == 
+            (piece[decoded - 2] | piece[decoded - 1] << 8))
+    {
+        f->type = piece[0];
+        f->len = decoded - 3;
+        memmove(f->data, &piece[1], f->len);
+        r->frames++;
+        return 1;
+    }
+    if (is_text(f->data, len))
+    {
+        f->type = FRAME_TEXT;
+        f->len = len;
+        return 1;
+    }
+    r->bad++;
+    return 0;
+}
+
+int frame_read(struct frame_reader *r, struct frame *f)
+{
+    int len = 0;
+    int overlong = 0;
+    int c;
+    
+    while ((c = getc(r->in)) != EOF)
+    {
+        if (c != 0)
+        {
+            if (!r->synced || overlong)
+            {
+                continue;
+            }
+            f->data[len++] = c;
+            if (len == FRAME_CHUNK_MAX)
+            {
+                // Too long for a frame. Pass text on in parts, drop the rest
+                // up to the next zero byte.
+                if (is_text(f->data, len))
+                {
+                    f->type = FRAME_TEXT;
+                    f->len = len;
+                    return 1;
+                }
+                r->bad++;
+                overlong = 1;
+            }
+            continue;
+        }
+        if (r->synced && !overlong && len > 0 && piece_decode(r, f, len))
+        {
+            return 1;
+        }
+        r->synced = 1;
+        overlong = 0;
+        len = 0;
+    }
+    // Text needs no zero byte at the end, a frame cut off by the end of the
+    // input is dropped
+    if (r->synced && !overlong && len > 0 && is_text(f->data, len))
+    {
+        f->type = FRAME_TEXT;
+        f->len = len;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * File:   frames.h
+ * Reads the frames of telemetry.h from a byte stream on the host.
+ *
+ * The stream is split at the zero bytes. A piece that is valid COBS with a
+ * correct CRC is a frame. Anything else made of printable characters is 
+ * text, such as the text reports of uart.c, and is passed on as it is. 
+ * The rest is counted as bad. The stream may start in the middle of a 
+ * frame, so everything up to the first zero byte is skipped.
+ */
+
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "telemetry.h"
+
+// Type of a piece of text between frames, not a frame type
+#define FRAME_TEXT              0x00
+// Longest piece handled at once, longer text is passed on in parts
+#define FRAME_CHUNK_MAX         512
+
+struct frame
+{
+    uint8_t type;           // TELEMETRY_* or FRAME_TEXT
+    int len;                // Payload or text length
+    uint8_t data[FRAME_CHUNK_MAX];
+};
+
+struct frame_reader
+{
+    FILE *in;
+    int synced;             // A zero byte has been seen
+    unsigned long frames;   // Valid frames read
+    unsigned long bad;      // Pieces that were neither frames nor text
+};
+
+/* Starts reading frames from in. */
+void frame_reader_init(struct frame_reader *r, FILE *in);
+
+/* Reads the next frame or piece of text into f. Returns 1, or 0 at the end
+ * of the input. */
+int frame_read(struct frame_reader *r, struct frame *f);
+
+#endif /* FRAMES_H */
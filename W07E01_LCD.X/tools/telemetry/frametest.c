@@ -0,0 +1,165 @@
+/*
+ * File:   frametest.c
+ * Checks the frames of telemetry.c against the reader in frames.c.
+ *
+ * A stream of frames of every type is written, with payloads full of zero
+ * bytes, without zero bytes, empty and of the largest size, mixed with 
+ * text reports. It is read back and every frame and piece of text must 
+ * come out as it went in. Then one byte of a frame is corrupted, which 
+ * must lose only that frame. The CRC is also checked against the standard
+ * check value of CRC-16/CCITT-FALSE.
+ *
+ * Usage:   make test
+ * Exits with 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frames.h"
+
+#define ITEMS                   8
+
+static const char text_report[] = 
+    "LDR Value: 512\r\nNTC Value: 300\r\nNTC Temp: 24.5 C\r\n"
+    "POT Value: 1023\r\n\n";
+
+static struct
+{
+    uint8_t type;
+    int len;
+    uint8_t data[TELEMETRY_PAYLOAD_MAX];
+} items[ITEMS];
+
+static int failures;
+
+static void fail(const char *what, int item)
+{
+    printf("  FAIL %s, item %d\n", what, item);
+    failures++;
+}
+
+static void make_items(void)
+{
+    for (int i = 0; i < ITEMS; i++)
+    {
+        items[i].type = TELEMETRY_REPORT + i % 3;
+    }
+    items[0].len = TELEMETRY_REPORT_BYTES;          // All zeros
+    items[1].len = 16;                              // No zeros
+    memset(items[1].data, 0xFF, 16);
+    items[2].len = 0;                               // Empty
+    items[3].len = TELEMETRY_PAYLOAD_MAX;           // Largest, mixed
+    for (int i = 0; i < TELEMETRY_PAYLOAD_MAX; i++)
+    {
+        items[3].data[i] = (i % 7 == 0) ? 0 : i;
+    }
+    items[4].type = FRAME_TEXT;                     // Text report
+    items[4].len = strlen(text_report);
+    memcpy(items[4].data, text_report, items[4].len);
+    items[5].len = 9;
+    memcpy(items[5].data, "\0\0\0\0\0\0\0\0\1", 9);
+    items[6].len = 1;                               // A single zero
+    items[7].len = 200;                             // Random
+    for (int i = 0; i < 200; i++)
+    {
+        items[7].data[i] = rand();
+    }
+}
+
+// Writes all items, with one bit flipped in the frame of corrupt_item
+static void write_stream(FILE *f, int corrupt_item)
+{
+    uint8_t frame[TELEMETRY_PAYLOAD_MAX + TELEMETRY_OVERHEAD];
+    
+    fputs("ff 01 02", f); // Tail of an earlier frame, skipped
+    for (int i = 0; i < ITEMS; i++)
+    {
+        if (items[i].type == FRAME_TEXT)
+        {
+            fwrite(items[i].data, 1, items[i].len, f);
+            continue;
+        }
+        size_t len = telemetry_encode(frame, items[i].type, items[i].data, 
+            items[i].len);
+        if (len != items[i].len + TELEMETRY_OVERHEAD)
+        {
+            fail("frame length", i);
+        }
+        if (memchr(&frame[1], 0, len - 2) || frame[0] || frame[len - 1])
+        {
+            fail("zero byte inside the frame", i);
+        }
+        if (i == corrupt_item)
+        {
+            frame[len / 2] ^= 0x10;
+        }
+        fwrite(frame, 1, len, f);
+    }
+}
+
+static void check_stream(int corrupt_item)
+{
+    struct frame_reader reader;
+    struct frame frame;
+    FILE *f = tmpfile();
+    int i = 0;
+    
+    write_stream(f, corrupt_item);
+    rewind(f);
+    frame_reader_init(&reader, f);
+    while (frame_read(&reader, &frame))
+    {
+        if (i == corrupt_item)
+        {
+            i++;
+        }
+        if (i >= ITEMS)
+        {
+            fail("extra frame", i);
+            break;
+        }
+        if ((frame.type != items[i].type) || (frame.len != items[i].len) ||
+            memcmp(frame.data, items[i].data, frame.len))
+        {
+            fail("frame changed", i);
+        }
+        i++;
+    }
+    if (i == corrupt_item)
+    {
+        i++;
+    }
+    if (i != ITEMS)
+    {
+        fail("frames missing", i);
+    }
+    if (reader.bad != (corrupt_item >= 0))
+    {
+        fail("bad count", corrupt_item);
+    }
+    fclose(f);
+}
+
+int main(void)
+{
+    const uint8_t check[] = "123456789";
+    
+    if (telemetry_crc16(0xFFFF, check, 9) != 0x29B1)
+    {
+        fail("CRC check value", 0);
+    }
+    make_items();
+    check_stream(-1);
+    printf("%d frames and text read back\n", ITEMS);
+    for (int corrupt = 0; corrupt < ITEMS; corrupt++)
+    {
+        if (items[corrupt].type != FRAME_TEXT)
+        {
+            check_stream(corrupt);
+        }
+    }
+    printf("a corrupted frame loses only itself\n");
+    printf("%s\n", failures ? "FAILED" : "all tests passed");
+    return failures ? 1 : 0;
+}
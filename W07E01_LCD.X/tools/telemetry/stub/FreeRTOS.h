@@ -0,0 +1,13 @@
+/*
+ * Just the FreeRTOS types that capture.h needs for the host build of
+ * capture2csv.
+ */
+
+#ifndef TELEMETRY_FREERTOS_H
+#define TELEMETRY_FREERTOS_H
+
+#include <stdint.h>
+
+typedef int8_t BaseType_t;
+
+#endif /* TELEMETRY_FREERTOS_H */
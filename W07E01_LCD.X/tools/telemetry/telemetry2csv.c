@@ -0,0 +1,113 @@
+/*
+ * File:   telemetry2csv.c
+ * Decodes the report frames of uart.c (UART_REPORT_BINARY) into CSV.
+ *
+ * The stream is read with frames.c. Every valid TELEMETRY_REPORT frame
+ * becomes one line
+ *      time_ms,seq,lost,ldr,ntc,pot,temp_c
+ * where time_ms keeps counting over the 16-bit wrap of the timestamp, lost
+ * is the number of reports missing before this one according to the 
+ * sequence number, and temp_c is ntc converted with ntc.c, empty when the
+ * reading is out of range. Text and other frames, such as the log records
+ * (tools/logexpand) and capture blocks (capture2csv), are skipped. Report,
+ * lost, other and bad counts are printed to stderr at the end.
+ *
+ * Usage:   make && stty -F /dev/ttyACM0 115200 raw && 
+ *          ./telemetry2csv < /dev/ttyACM0 > readings.csv
+ *      or  ./telemetry2csv capture.bin > readings.csv
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "frames.h"
+#include "ntc.h"
+
+static unsigned long reports;
+static unsigned long bad_reports;
+static unsigned long lost_reports;
+
+static void report_decode(const uint8_t *buf, int len)
+{
+    static int started;
+    static uint8_t prev_seq;
+    static uint16_t prev_time;
+    static unsigned long time_ms;
+    uint16_t values[TELEMETRY_VALUES];
+    uint16_t time;
+    uint8_t seq;
+    int16_t temp;
+    
+    if (len != TELEMETRY_REPORT_BYTES)
+    {
+        bad_reports++;
+        return;
+    }
+    seq = buf[0];
+    time = buf[1] | buf[2] << 8;
+    for (int i = 0; i < TELEMETRY_VALUES; i++)
+    {
+        values[i] = buf[3 + 2 * i] | buf[4 + 2 * i] << 8;
+    }
+    
+    unsigned lost = 0;
+    if (started)
+    {
+        lost = (uint8_t)(seq - prev_seq - 1);
+        time_ms += (uint16_t)(time - prev_time);
+    }
+    else
+    {
+        time_ms = time;
+        started = 1;
+    }
+    prev_seq = seq;
+    prev_time = time;
+    reports++;
+    lost_reports += lost;
+    
+    printf("%lu,%u,%u,%u,%u,%u,", time_ms, seq, lost, values[0], 
+        values[1], values[2]);
+    temp = ntc_temperature(values[1]);
+    if (temp == NTC_OUT_OF_RANGE)
+    {
+        // Empty field, the temperature is unknown
+        printf("\n");
+    }
+    else
+    {
+        printf("%s%d.%d\n", temp < 0 ? "-" : "", 
+            (temp < 0 ? -temp : temp) / 10, (temp < 0 ? -temp : temp) % 10);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    struct frame_reader reader;
+    struct frame frame;
+    unsigned long other = 0;
+    
+    if (argc > 1 && !(in = fopen(argv[1], "rb")))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    frame_reader_init(&reader, in);
+    printf("time_ms,seq,lost,ldr,ntc,pot,temp_c\n");
+    while (frame_read(&reader, &frame))
+    {
+        if (frame.type == TELEMETRY_REPORT)
+        {
+            report_decode(frame.data, frame.len);
+            fflush(stdout);
+        }
+        else
+        {
+            other++;
+        }
+    }
+    fprintf(stderr, "%lu reports, %lu lost, %lu other frames or text, "
+        "%lu bad\n", reports, lost_reports, other, 
+        reader.bad + bad_reports);
+    return 0;
+}
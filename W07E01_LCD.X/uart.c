@@ -1,60 +1,246 @@
 /*
  * File:   uart.c
  * Functions for UART usage.
+ *
+ * uart_write() copies the data into a transmit ring buffer and returns, the
+ * data register empty (DRE) interrupt feeds the transmitter from the ring.
+ * A writer only waits when the ring is full.
+ *
+ * The reports are either text for a terminal or, with UART_REPORT_BINARY,
+ * telemetry frames (see telemetry.h) for tools/telemetry. A text report 
+ * takes up to 79 bytes (UART_TEXT_REPORT_MAX) and a frame 15 bytes. At 
+ * 115200 baud the link carries 11520 bytes per second, about 145 of the 
+ * longest text reports or 768 frames, so frames carry over five times more
+ * readings. Frames are sent after every scan that converts any input, at 
+ * most 64 per second, which uses 8 % of the link.
+ *
+ * The text report is built with format.c instead of sprintf, which keeps
+ * vfprintf out of the image and the task on the minimal stack. The task 
+ * logs its stack headroom. To compare against sprintf on the target, set 
+ * UART_FORMAT_BENCH in uart.h: every report then logs the cycles of 
+ * format_u16() and snprintf() for the same number, and the flash cost of
+ * vfprintf is the size difference of the two builds.
  */
 
-#define F_CPU 3333333
-#define USART0_BAUD_RATE(BAUD_RATE)\
-    ((float)(F_CPU * 64 / (16 * (float)BAUD_RATE)) + 0.5)
+/*
+ * UART_BAUD           - Baud rate of the reports
+ * UART_BAUD_ERROR_MAX - Largest accepted baud rate error in 0,1 % units
+ * UART_TX_BUFFER_SIZE - Transmit ring size in bytes, must be a power of two
+ * UART_REPORT_BINARY  - 1 = reports as telemetry frames, 0 = as text
+ */
+#define UART_BAUD               115200
+#define UART_BAUD_ERROR_MAX     20
+#define UART_TX_BUFFER_SIZE     128
+#define UART_REPORT_BINARY      0
 
 #include <avr/io.h>
-#include "string.h"
-#include "stdio.h"
+#include <avr/interrupt.h>
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
 #include "adc.h"
+#include "sensorbus.h"
+#include "format.h"
+#include "ntc.h"
+#include "telemetry.h"
+#include "uart.h"
+#include "log.h"
+#if UART_FORMAT_BENCH
+#include <stdio.h>
+#include "cycles.h"
+#endif
+
+// BAUD register value when every bit is sampled S times (16 in normal mode,
+// 8 in CLK2X mode). The register has 6 fractional bits, so it is 
+// 64 * f / (S * baud), rounded to nearest.
+#define UART_BAUD_VALUE(S) \
+    ((64 * configCPU_CLOCK_HZ / (S) + UART_BAUD / 2) / UART_BAUD)
+// Resulting baud rate error in 0,1 % units, only for #if
+#define UART_BAUD_ERROR(S) \
+    ((64000 * configCPU_CLOCK_HZ / ((S) * UART_BAUD_VALUE(S)) \
+    - 1000 * UART_BAUD) / UART_BAUD)
+#define UART_BAUD_OK(S) \
+    (UART_BAUD_VALUE(S) >= 64 && UART_BAUD_VALUE(S) <= 0xFFFF && \
+    UART_BAUD_ERROR(S) <= UART_BAUD_ERROR_MAX && \
+    UART_BAUD_ERROR(S) >= -UART_BAUD_ERROR_MAX)
+
+// Normal mode tolerates more error at the receiver, so CLK2X is only used
+// when the baud rate is too high for normal mode. With 3,33 MHz normal mode
+// reaches 208333 baud and CLK2X 416666 baud.
+#if UART_BAUD_OK(16)
+#define UART_BAUD_REG           UART_BAUD_VALUE(16)
+#define UART_RXMODE             USART_RXMODE_NORMAL_gc
+#elif UART_BAUD_OK(8)
+#define UART_BAUD_REG           UART_BAUD_VALUE(8)
+#define UART_RXMODE             USART_RXMODE_CLK2X_gc
+#else
+#error "UART_BAUD is not possible with configCPU_CLOCK_HZ within UART_BAUD_ERROR_MAX"
+#endif
+
+#if TELEMETRY_VALUES != ADC_CHANNELS
+#error "Telemetry frames must carry every ADC input"
+#endif
 
+static SemaphoreHandle_t uart_mutex;
+
+// Transmit ring. head is only written by uart_write(), tail by the ISR.
+static uint8_t uart_tx_buffer[UART_TX_BUFFER_SIZE];
+static volatile uint8_t uart_tx_head;
+static volatile uint8_t uart_tx_tail;
 
 void uart_init(void)
 {
+    uart_mutex = xSemaphoreCreateMutex(); // Create mutex
+    
     PORTA.DIRSET = PIN0_bm; // PA0 out
-    USART0.BAUD = (uint16_t)USART0_BAUD_RATE(9600); // Use baud rate of 9600
-    USART0.CTRLB |= USART_TXEN_bm;  // Enable USART write mode
+    USART0.BAUD = UART_BAUD_REG; // Use baud rate of UART_BAUD
+    // Enable USART write mode, with CLK2X if UART_BAUD needs it
+    USART0.CTRLB |= USART_TXEN_bm | UART_RXMODE;
+}
+
+void uart_write(const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    
+    uint8_t next;
+    
+    // Writes from different tasks do not get mixed
+    xSemaphoreTake(uart_mutex, portMAX_DELAY);
+    while (len--)
+    {
+        next = (uart_tx_head + 1) & (UART_TX_BUFFER_SIZE - 1);
+        while (next == uart_tx_tail)
+        {
+            vTaskDelay(1); // Ring full, let the ISR drain it
+        }
+        uart_tx_buffer[uart_tx_head] = *bytes++;
+        uart_tx_head = next;
+        // Start the ISR if it has stopped, it stops itself once the ring is
+        // empty
+        USART0.CTRLA |= USART_DREIE_bm;
+    }
+    xSemaphoreGive(uart_mutex);
+}
+
+#if UART_REPORT_BINARY
+
+void uart_send_reports(void* parameter)
+{
+    // Static to keep the task within configMINIMAL_STACK_SIZE
+    static uint8_t frame[TELEMETRY_FRAME_BYTES];
+    struct adc_snapshot readings;
+    uint8_t seq = 0;
+    size_t len;
+    
+    // A frame after every scan of any input, so each new result is sent
+    sensorbus_subscribe(SENSORBUS_INPUT(LDR) | SENSORBUS_INPUT(NTC) | 
+        SENSORBUS_INPUT(POT), 1);
+    
+    while (1)
+    {
+        sensorbus_wait(&readings);
+        
+        len = telemetry_frame(frame, seq++, xTaskGetTickCount(), 
+            readings.value);
+        uart_write(frame, len);
+    }
+    vTaskDelete(NULL);
+}
+
+#else
+
+#if UART_FORMAT_BENCH
+// Converts the same number with format_u16() and snprintf() and logs the 
+// cycles of both. Interrupts in between are included, so the lowest of 
+// several reports is the cost of the call.
+static void uart_format_bench(uint16_t value)
+{
+    char number[6];
+    uint16_t start;
+    uint16_t format_cycles;
+    uint16_t snprintf_cycles;
+    
+    start = cycles_now();
+    format_u16(number, value, 0);
+    format_cycles = cycles_since(start);
+    
+    start = cycles_now();
+    snprintf(number, sizeof(number), "%u", value);
+    snprintf_cycles = cycles_since(start);
+    
+    LOG3("%u: format_u16 %u cycles, snprintf %u cycles", value, 
+        format_cycles, snprintf_cycles);
 }
+#endif
+
+// Longest text report with its terminating NUL: 5 digit values and the
+// temperature "out of range", which is longer than any number
+#define UART_TEXT_REPORT_MAX \
+    sizeof("LDR Value: 65535\r\nNTC Value: 65535\r\nNTC Temp: out of range" \
+        "\r\nPOT Value: 65535\r\n\n")
+
+_Static_assert(sizeof("-3276.8 C") <= sizeof("out of range"), 
+    "UART_TEXT_REPORT_MAX too short for the temperature");
 
 void uart_send_reports(void* parameter)
 {
-    char msg_string[60];    
-    uint16_t ldr_reading;
-    uint16_t ntc_reading;
-    uint16_t pot_reading;
+    // Static to keep the task within configMINIMAL_STACK_SIZE
+    static char msg_string[UART_TEXT_REPORT_MAX];
+    struct adc_snapshot readings;
+    TickType_t wake;
+    int16_t temp;
     
     // 200 ms delay before entering superloop
     vTaskDelay(200 / portTICK_PERIOD_MS);
+    // Report once a second. The inputs are converted at adaptive rates, so
+    // the report keeps its own period and takes the latest results.
+    wake = xTaskGetTickCount();
     while (1) 
     { 
-        ldr_reading = adc_read(LDR);
-        ntc_reading = adc_read(NTC);
-        pot_reading = adc_read(POT);
+        vTaskDelayUntil(&wake, 1000 / portTICK_PERIOD_MS);
+        // All three readings as of the same scan
+        adc_snapshot_get(&readings);
         
         // Put these readings into one message string
-        sprintf(msg_string, 
-            "LDR Value: %u\r\nNTC Value: %u\r\nPOT Value: %u\r\n\n", 
-            ldr_reading, ntc_reading, pot_reading);
-
-        // Iterate through the message string and send each character 
-        // one at a time
-        for (size_t i = 0; i < strlen(msg_string); i++)
-            {
-            while (!(USART0.STATUS & USART_DREIF_bm))
-            {
-                ; // Wait until data can be sent
-            }
-            USART0.TXDATAL = msg_string[i];
+        char *p = format_str(msg_string, "LDR Value: ");
+        p = format_u16(p, readings.value[LDR], 0);
+        p = format_str(p, "\r\nNTC Value: ");
+        p = format_u16(p, readings.value[NTC], 0);
+        p = format_str(p, "\r\nNTC Temp: ");
+        temp = ntc_temperature(readings.value[NTC]);
+        if (temp == NTC_OUT_OF_RANGE)
+        {
+            p = format_str(p, "out of range");
         }
+        else
+        {
+            p = format_str(format_tenths(p, temp), " C");
+        }
+        p = format_str(p, "\r\nPOT Value: ");
+        p = format_u16(p, adc_to_10bit(POT, readings.value[POT]), 0);
+        p = format_str(p, "\r\n\n");
         
-        // Wait 1 second before sending the next report
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        uart_write(msg_string, p - msg_string);
+#if UART_FORMAT_BENCH
+        uart_format_bench(readings.value[LDR]);
+#endif
+        LOG_STACK("uart");
     }
     vTaskDelete(NULL);
 }
+
+#endif
+
+ISR(USART0_DRE_vect)
+{
+    uint8_t tail = uart_tx_tail;
+    
+    if (tail == uart_tx_head)
+    {
+        // Nothing left to send, stop until uart_write() restarts the ISR
+        USART0.CTRLA &= ~USART_DREIE_bm;
+        return;
+    }
+    USART0.TXDATAL = uart_tx_buffer[tail];
+    uart_tx_tail = (tail + 1) & (UART_TX_BUFFER_SIZE - 1);
+}
@@ -1,11 +1,30 @@
 #ifndef UART_H
 #define	UART_H
 
+#include <stddef.h>
+
+/*
+ * UART_FORMAT_BENCH - 1 = the text report also times snprintf against 
+ *                     format_u16() and logs the cycles, see uart.c
+ * UART_REPORT_STACK - Stack depth of uart_send_reports, snprintf needs 
+ *                     more than the minimal stack
+ */
+#define UART_FORMAT_BENCH       0
+#define UART_REPORT_STACK \
+    (configMINIMAL_STACK_SIZE + (UART_FORMAT_BENCH ? 100 : 0))
+
 /* Makes all required inital configurations for UART usage. */
 void uart_init(void);
 
+/* Queues len bytes of data to be sent via UART by the transmit interrupt. 
+ * Mutex-protected, so that data from different tasks does not get mixed. 
+ * Only blocks while the transmit ring is full. */
+void uart_write(const void *data, size_t len);
+
 /* Sends a report strings via UART every second.
- * The report strings contain readings from LDR, NTC and potentiometer */
+ * The report strings contain readings from LDR, NTC and potentiometer. 
+ * With UART_REPORT_BINARY in uart.c it sends telemetry frames after every
+ * scan instead. */
 void uart_send_reports(void* parameter);
 
 #endif	/* UART_H */